@@ -27,10 +27,12 @@ SOFTWARE.
 #include <matplotlibcpp.h>
 namespace plt = matplotlibcpp;
 
+#include <probability/expression.h>
 #include <probability/time.h>
 #include <probability/wiener_process.h>
 #include <probability/state.h>
 #include <probability/path.h>
+#include <probability/path_block.h>
 
 #include <sstream>
 
@@ -60,26 +62,14 @@ namespace irm {
         double drift = mu - .5*sigma*sigma;
         return std::exp(drift*t + sigma*w);
       };
-    auto geometricBrownianDefn = 
-      [=](Time t, const IState & state)
-      {
-        double w = state.getValue(W);
-        return gbf(t, w);
-      };
-    StateVariable IGB(0);
-    auto igbDrift =
-      [&](Time, const IState & state) {
-        double igbPrev = state.getValue(IGB);
-        return igbPrev * mu;
-      };
-    auto igbVol =
-      [&](Time, const IState & state) {
-        double igbPrev = state.getValue(IGB);
-        return igbPrev * sigma;
-      };
+    using namespace expr;
+    auto geometricBrownianDefn = exp((mu - .5*sigma*sigma) * t + sigma * X(W));
+    StateVariable IGB = process.getNextStateVariable();
+    auto igbDrift = X(IGB) * mu;
+    auto igbVol = X(IGB) * sigma;
 
-    StateVariable GB = process.addDerivedStateVariable(geometricBrownianDefn, gbf(t0, initialW));
     IGB = process.addItoIntegralProcess(igbDrift, igbVol, gbf(t0, initialW));
+    StateVariable GB = process.addDerivedStateVariable(geometricBrownianDefn, gbf(t0, initialW));
 
     std::default_random_engine dre(seed);
     std::vector<double> x, y;
@@ -87,19 +77,18 @@ namespace irm {
     for (int i = 0; i < timeVector->getNumTimes(); ++i)
       x.push_back(timeVector->getTimeAtIndex(i));
 
+    auto paths = process.generatePaths(dre, numPaths);
     for (int ipath = 0; ipath < numPaths; ++ipath)
     {
-      auto path = process.generatePath(dre);
-
-      y.resize(path->getNumTimes(), 0);
-      for (int i = 0; i < path->getNumTimes(); ++i)
-        y[i] = path->getStateAtIndex(i).getValue(GB);
+      y.resize(paths->getNumTimes(), 0);
+      for (int i = 0; i < paths->getNumTimes(); ++i)
+        y[i] = paths->getValue(ipath, i, GB);
       std::stringstream gbname;
       gbname << "GB_" << ipath;
       plt::named_plot(gbname.str(), x, y);
 
-      for (int i = 0; i < path->getNumTimes(); ++i)
-        y[i] = path->getStateAtIndex(i).getValue(IGB);
+      for (int i = 0; i < paths->getNumTimes(); ++i)
+        y[i] = paths->getValue(ipath, i, IGB);
       std::stringstream igbname;
       igbname << "IGB_" << ipath;
       plt::named_plot(igbname.str(), x, y);
@@ -0,0 +1,114 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "brownian_bridge.h"
+#include "time.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace irm {
+
+    BrownianBridge::BrownianBridge(const ITimeVector & timeVector)
+    {
+        int numSteps = std::max(timeVector.getNumTimes() - 1, 0);
+        // time of point i, relative to the start of the path, point -1 being the start itself
+        auto time = [&](int i) { return timeVector.getTimeAtIndex(i + 1) - timeVector.getTimeAtIndex(0); };
+        for (int i = 1; i < numSteps; ++i)
+            if (time(i) < time(i - 1))
+                throw std::invalid_argument("BrownianBridge: times must be increasing");
+
+        m_bridgeIndex.resize(numSteps);
+        m_leftIndex.resize(numSteps);
+        m_rightIndex.resize(numSteps);
+        m_leftWeight.resize(numSteps);
+        m_rightWeight.resize(numSteps);
+        m_stdDev.resize(numSteps);
+        if (numSteps == 0)
+            return;
+
+        // the terminal point first
+        std::vector<bool> isBuilt(numSteps, false);
+        isBuilt[numSteps - 1] = true;
+        m_bridgeIndex[0] = numSteps - 1;
+        m_leftIndex[0] = -1;
+        m_rightIndex[0] = numSteps - 1;
+        m_leftWeight[0] = 0;
+        m_rightWeight[0] = 0;
+        m_stdDev[0] = std::sqrt(time(numSteps - 1));
+
+        // then the midpoint of each gap between built points, sweeping the path left to right repeatedly
+        int gapBegin = 0;
+        for (int i = 1; i < numSteps; ++i) {
+            while (isBuilt[gapBegin])
+                gapBegin = (gapBegin + 1) % numSteps;
+            int right = gapBegin;
+            while (!isBuilt[right])
+                ++right;
+            int mid = gapBegin + (right - 1 - gapBegin) / 2;
+            int left = gapBegin - 1;
+            isBuilt[mid] = true;
+
+            Time tLeft = left < 0 ? 0 : time(left);
+            Time span = time(right) - tLeft;
+            m_bridgeIndex[i] = mid;
+            m_leftIndex[i] = left;
+            m_rightIndex[i] = right;
+            if (span > 0) {
+                m_leftWeight[i] = (time(right) - time(mid)) / span;
+                m_rightWeight[i] = (time(mid) - tLeft) / span;
+                m_stdDev[i] = std::sqrt((time(mid) - tLeft) * (time(right) - time(mid)) / span);
+            } else {
+                m_leftWeight[i] = 1;
+                m_rightWeight[i] = 0;
+                m_stdDev[i] = 0;
+            }
+
+            gapBegin = (right + 1) % numSteps;
+        }
+    }
+
+    void BrownianBridge::buildPath(const double * normals, double * path, std::size_t stride) const {
+        int numSteps = getNumSteps();
+        if (numSteps == 0)
+            return;
+        path[(numSteps - 1) * stride] = m_stdDev[0] * normals[0];
+        for (int i = 1; i < numSteps; ++i) {
+            int left = m_leftIndex[i];
+            double wLeft = left < 0 ? 0 : path[left * stride];
+            path[m_bridgeIndex[i] * stride] =
+                    m_leftWeight[i] * wLeft
+                    + m_rightWeight[i] * path[m_rightIndex[i] * stride]
+                    + m_stdDev[i] * normals[i * stride];
+        }
+    }
+
+    void BrownianBridge::buildIncrements(const double * normals, double * increments, std::size_t stride) const {
+        buildPath(normals, increments, stride);
+        for (int i = getNumSteps() - 1; i > 0; --i)
+            increments[i * stride] -= increments[(i - 1) * stride];
+    }
+
+} // end namespace irm
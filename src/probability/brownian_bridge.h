@@ -0,0 +1,83 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_BROWNIAN_BRIDGE_H
+#define INTEREST_RATE_MODELLING_BROWNIAN_BRIDGE_H
+
+#include "fwd_decl.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class BrownianBridge
+     * Builds a brownian path on a time vector from standard normals by brownian bridge:
+     *   the first normal gives the terminal value, the next ones the midpoints of the gaps, level by level.
+     * So the first normals carry most of the variance of the path,
+     *   which is what makes quasi random normals (see SobolSequence) converge faster.
+     * The construction order, weights and standard deviations are computed once, in the constructor.
+     */
+    class BrownianBridge {
+    public:
+
+        /** Constructor
+         *
+         * @param timeVector The increasing times of the path, the first one being the start of the path.
+         */
+        explicit BrownianBridge(const ITimeVector & timeVector);
+
+        /** The number of steps of the path, which is also the number of normals it consumes. */
+        int getNumSteps() const { return m_bridgeIndex.size(); }
+
+        /**
+         * Function to build the brownian path W(t_i) - W(t_0), for i = 1 ... getNumSteps()
+         * @param normals The getNumSteps() standard normals, normals[i * stride] being the i-th.
+         * @param path Output, W(t_i) - W(t_0) being written to path[(i - 1) * stride].
+         *             Must not overlap with normals.
+         */
+        void buildPath(const double * normals, double * path, std::size_t stride = 1) const;
+
+        /** Same as buildPath, writing the increments W(t_i) - W(t_{i-1}) instead. */
+        void buildIncrements(const double * normals, double * increments, std::size_t stride = 1) const;
+
+    private:
+
+        // step i of the construction sets point m_bridgeIndex[i] from the points
+        // m_leftIndex[i] and m_rightIndex[i], -1 being the start of the path, where W is 0
+        std::vector<int> m_bridgeIndex;
+        std::vector<int> m_leftIndex;
+        std::vector<int> m_rightIndex;
+        std::vector<double> m_leftWeight;
+        std::vector<double> m_rightWeight;
+        std::vector<double> m_stdDev;
+    }; // end class BrownianBridge
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_BROWNIAN_BRIDGE_H
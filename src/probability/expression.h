@@ -0,0 +1,175 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_EXPRESSION_H
+#define INTEREST_RATE_MODELLING_EXPRESSION_H
+
+#include "fwd_decl.h"
+#include "state.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace irm {
+namespace expr {
+
+
+    /**
+     * Expression templates over state variables, time and constants,
+     *   eg. mu * X(IGB) or exp(a * t + s * X(W)).
+     * An expression keeps its whole structure in its type, so evaluating it compiles to straight-line arithmetic.
+     * It evaluates on a state given as a pointer to its first value and the stride between its values,
+     *   which is how both a single StateView and one path of a PathBlock are laid out.
+     * That lets WienerProcess evaluate an expression across all the paths of a block
+     *   in one fused loop, instead of calling a StateFunction per path.
+     * Expressions are also callable as StateFunctions: f(Time, const StateView &).
+     */
+    template<typename Derived>
+    struct Expression {
+        const Derived & derived() const { return static_cast<const Derived &>(*this); }
+
+        double operator()(Time t, const StateView & state) const {
+            return derived().evaluate(t, state.getData(), state.getStride());
+        }
+
+        /** The state variables read by the expression, in no particular order, possibly repeated. */
+        std::vector<StateVariable> getVariables() const {
+            std::vector<StateVariable> variables;
+            derived().collectVariables(variables);
+            return variables;
+        }
+    };
+
+
+    struct Constant : Expression<Constant> {
+        constexpr explicit Constant(double v) : value(v) {}
+        double evaluate(Time, const double *, std::size_t) const { return value; }
+        void collectVariables(std::vector<StateVariable> &) const {}
+        double value;
+    };
+
+    struct TimeValue : Expression<TimeValue> {
+        double evaluate(Time t, const double *, std::size_t) const { return t; }
+        void collectVariables(std::vector<StateVariable> &) const {}
+    };
+
+    struct Variable : Expression<Variable> {
+        explicit Variable(StateVariable x) : index(x.index) {}
+        double evaluate(Time, const double * values, std::size_t stride) const { return values[index * stride]; }
+        void collectVariables(std::vector<StateVariable> & variables) const { variables.emplace_back(index); }
+        int index;
+    };
+
+    template<typename Op, typename A>
+    struct UnaryExpression : Expression<UnaryExpression<Op, A>> {
+        explicit UnaryExpression(const A & a) : arg(a) {}
+        double evaluate(Time t, const double * values, std::size_t stride) const {
+            return Op::apply(arg.evaluate(t, values, stride));
+        }
+        void collectVariables(std::vector<StateVariable> & variables) const { arg.collectVariables(variables); }
+        A arg;
+    };
+
+    template<typename Op, typename A, typename B>
+    struct BinaryExpression : Expression<BinaryExpression<Op, A, B>> {
+        BinaryExpression(const A & a, const B & b) : left(a), right(b) {}
+        double evaluate(Time t, const double * values, std::size_t stride) const {
+            return Op::apply(left.evaluate(t, values, stride), right.evaluate(t, values, stride));
+        }
+        void collectVariables(std::vector<StateVariable> & variables) const {
+            left.collectVariables(variables);
+            right.collectVariables(variables);
+        }
+        A left;
+        B right;
+    };
+
+
+    /** The value of the state variable x. */
+    inline Variable X(StateVariable x) { return Variable(x); }
+
+    /** The current time. */
+    inline constexpr TimeValue t{};
+
+
+    // operations
+    struct Plus { static double apply(double a, double b) { return a + b; } };
+    struct Minus { static double apply(double a, double b) { return a - b; } };
+    struct Multiplies { static double apply(double a, double b) { return a * b; } };
+    struct Divides { static double apply(double a, double b) { return a / b; } };
+    struct Max { static double apply(double a, double b) { return std::max(a, b); } };
+    struct Min { static double apply(double a, double b) { return std::min(a, b); } };
+    struct Negate { static double apply(double a) { return -a; } };
+    struct Exp { static double apply(double a) { return std::exp(a); } };
+    struct Log { static double apply(double a) { return std::log(a); } };
+    struct Sqrt { static double apply(double a) { return std::sqrt(a); } };
+    struct Abs { static double apply(double a) { return std::abs(a); } };
+
+
+    // each binary operation combines two expressions, or an expression and a double
+#define IRM_EXPR_BINARY_OPERATION(name, Op) \
+    template<typename A, typename B> \
+    BinaryExpression<Op, A, B> name(const Expression<A> & a, const Expression<B> & b) { \
+        return BinaryExpression<Op, A, B>(a.derived(), b.derived()); \
+    } \
+    template<typename A> \
+    BinaryExpression<Op, A, Constant> name(const Expression<A> & a, double b) { \
+        return BinaryExpression<Op, A, Constant>(a.derived(), Constant(b)); \
+    } \
+    template<typename B> \
+    BinaryExpression<Op, Constant, B> name(double a, const Expression<B> & b) { \
+        return BinaryExpression<Op, Constant, B>(Constant(a), b.derived()); \
+    }
+
+    IRM_EXPR_BINARY_OPERATION(operator +, Plus)
+    IRM_EXPR_BINARY_OPERATION(operator -, Minus)
+    IRM_EXPR_BINARY_OPERATION(operator *, Multiplies)
+    IRM_EXPR_BINARY_OPERATION(operator /, Divides)
+    IRM_EXPR_BINARY_OPERATION(max, Max)
+    IRM_EXPR_BINARY_OPERATION(min, Min)
+
+#undef IRM_EXPR_BINARY_OPERATION
+
+#define IRM_EXPR_UNARY_OPERATION(name, Op) \
+    template<typename A> \
+    UnaryExpression<Op, A> name(const Expression<A> & a) { \
+        return UnaryExpression<Op, A>(a.derived()); \
+    }
+
+    IRM_EXPR_UNARY_OPERATION(operator -, Negate)
+    IRM_EXPR_UNARY_OPERATION(exp, Exp)
+    IRM_EXPR_UNARY_OPERATION(log, Log)
+    IRM_EXPR_UNARY_OPERATION(sqrt, Sqrt)
+    IRM_EXPR_UNARY_OPERATION(abs, Abs)
+
+#undef IRM_EXPR_UNARY_OPERATION
+
+
+} // end namespace expr
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_EXPRESSION_H
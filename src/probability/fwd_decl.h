@@ -30,14 +30,45 @@ SOFTWARE.
 
 namespace irm {
 
+    // brownian_bridge.h
+    class BrownianBridge;
+    typedef std::shared_ptr<const BrownianBridge> BrownianBridgeCPtr;
+
+    // monte_carlo_engine.h
+    class MonteCarloEngine;
+
+    // multilevel_monte_carlo.h
+    class MultilevelMonteCarlo;
+
     // path.h
     class IPath;
     typedef std::shared_ptr<const IPath> IPathCPtr;
     typedef std::shared_ptr<IPath> IPathPtr;
 
+    // path_block.h
+    class PathBlock;
+    typedef std::shared_ptr<const PathBlock> PathBlockCPtr;
+    typedef std::shared_ptr<PathBlock> PathBlockPtr;
+
+    // path_exporter.h
+    class PathExporter;
+
+    // path_statistics.h
+    class RunningStatistics;
+    class PathStatistics;
+
+    // path_store.h
+    class PathStoreWriter;
+    class PathStore;
+    typedef std::shared_ptr<const PathStore> PathStoreCPtr;
+
+    // scenario_cache.h
+    class ScenarioCache;
+
     // state.h
     class StateVariable;
     class IState;
+    class StateView;
     typedef std::shared_ptr<const IState> IStateCPtr;
     typedef std::shared_ptr<IState> IStatePtr;
 
@@ -47,6 +78,10 @@ namespace irm {
     typedef std::shared_ptr<const ITimeVector> ITimeVectorCPtr;
     typedef std::shared_ptr<ITimeVector> ITimeVectorPtr;
 
+    // time_grid.h
+    class ITimeGrid;
+    typedef std::shared_ptr<const ITimeGrid> ITimeGridCPtr;
+
     // wiener_process.h
     class WienerProcess;
     typedef std::shared_ptr<const WienerProcess> WienerProcessCPtr;
@@ -0,0 +1,213 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "monte_carlo_engine.h"
+
+#include "normal_sampler.h"
+#include "path_block.h"
+#include "path_statistics.h"
+#include "wiener_process.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // number of consecutive paths handed to a thread at a time
+    const int PathsPerChunk = 64;
+
+} // end anonymous namespace
+
+namespace irm {
+
+    MonteCarloEngine::MonteCarloEngine(
+            WienerProcessCPtr process,
+            int numPaths,
+            std::uint64_t seed,
+            int numThreads):
+            m_process(process),
+            m_numPaths(numPaths),
+            m_seed(seed),
+            m_numThreads(numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency()))
+    {
+        if (!m_process)
+            throw std::invalid_argument("MonteCarloEngine: null process");
+        if (numPaths < 0)
+            throw std::invalid_argument("MonteCarloEngine: negative number of paths");
+    }
+
+    MonteCarloEngine::RandomNumberGenerator MonteCarloEngine::createPathGenerator(std::uint64_t seed, std::int64_t pathIndex) {
+        return RandomNumberGenerator(seed, static_cast<std::uint64_t>(pathIndex));
+    }
+
+    PathBlockCPtr MonteCarloEngine::generatePaths() const {
+        const WienerProcess & process = *m_process;
+        auto block = std::make_shared<PathBlock>(process.m_timeGrid, m_numPaths, process.m_initialValue.size());
+        forEachChunk(0, m_numPaths, [&](int pathBegin, int pathEnd) {
+            auto brownianSamples = drawBrownianSamples(pathBegin, pathEnd);
+            process.fillPathBlock(brownianSamples.data(), *block, pathBegin, pathEnd);
+        });
+        return block;
+    }
+
+    PathBlockCPtr MonteCarloEngine::generatePaths(const std::vector<int> & observationIndices) const {
+        const WienerProcess & process = *m_process;
+        auto observationTimes = process.getObservationTimeVector(observationIndices);
+        auto block = std::make_shared<PathBlock>(observationTimes, m_numPaths, process.m_initialValue.size());
+        forEachChunk(0, m_numPaths, [&](int pathBegin, int pathEnd) {
+            auto brownianSamples = drawBrownianSamples(pathBegin, pathEnd);
+            process.fillObservedPathBlock(brownianSamples.data(), observationIndices, *block, pathBegin, pathEnd);
+        });
+        return block;
+    }
+
+    PathStatistics MonteCarloEngine::computeStatistics(const std::vector<int> & observationIndices) const {
+        const WienerProcess & process = *m_process;
+        auto observationTimes = process.getObservationTimeVector(observationIndices);
+        int stateSize = process.m_initialValue.size();
+        PathStatistics statistics(observationTimes, stateSize);
+
+        // chunks are merged in path order, whichever thread finishes first,
+        // so the statistics do not depend on the number of threads
+        std::map<int, PathStatistics> finishedChunks;
+        int nextChunk = 0;
+        std::mutex statisticsMutex;
+        forEachChunk(0, m_numPaths, [&](int pathBegin, int pathEnd) {
+            auto chunk = std::make_shared<PathBlock>(observationTimes, pathEnd - pathBegin, stateSize);
+            auto brownianSamples = drawBrownianSamples(pathBegin, pathEnd);
+            process.fillObservedPathBlock(brownianSamples.data(), observationIndices, *chunk, 0, pathEnd - pathBegin);
+            PathStatistics chunkStatistics(observationTimes, stateSize);
+            chunkStatistics.addPaths(*chunk);
+
+            std::lock_guard<std::mutex> lock(statisticsMutex);
+            finishedChunks.emplace(pathBegin / PathsPerChunk, std::move(chunkStatistics));
+            for (auto next = finishedChunks.find(nextChunk); next != finishedChunks.end(); next = finishedChunks.find(nextChunk)) {
+                statistics.merge(next->second);
+                finishedChunks.erase(next);
+                ++nextChunk;
+            }
+        });
+        return statistics;
+    }
+
+    std::vector<double> MonteCarloEngine::drawBrownianSamples(int pathBegin, int pathEnd) const {
+        int numSamples = m_process->getRequiredNumberOfSamples();
+        int chunkSize = pathEnd - pathBegin;
+        std::vector<double> brownianSamples(static_cast<size_t>(numSamples) * chunkSize);
+        for (int ip = 0; ip < chunkSize; ++ip) {
+            auto rng = createPathGenerator(m_seed, pathBegin + ip);
+            NormalSampler::fillStrided(rng, brownianSamples.data() + ip, numSamples, chunkSize);
+        }
+        return brownianSamples;
+    }
+
+    MonteCarloEngine::ConvergenceResult MonteCarloEngine::generateUntilConverged(
+            const std::vector<ConvergenceTarget> & targets,
+            const std::vector<int> & observationIndices,
+            int pathsPerBatch,
+            double maxSeconds) const
+    {
+        if (targets.empty())
+            throw std::invalid_argument("MonteCarloEngine: no convergence target");
+        for (const ConvergenceTarget & target : targets)
+            if (!target.quantity || !(target.tolerance > 0))
+                throw std::invalid_argument("MonteCarloEngine: convergence targets need a quantity and a positive tolerance");
+        if (pathsPerBatch < 2)
+            throw std::invalid_argument("MonteCarloEngine: batches need at least two paths");
+
+        auto start = std::chrono::steady_clock::now();
+        const WienerProcess & process = *m_process;
+        auto observationTimes = process.getObservationTimeVector(observationIndices);
+        int stateSize = process.m_initialValue.size();
+        size_t numTargets = targets.size();
+        ConvergenceResult result{ std::vector<RunningStatistics>(numTargets), 0, false };
+        while (result.numPaths < m_numPaths) {
+            int batchBegin = result.numPaths;
+            int batchSize = std::min(pathsPerBatch, m_numPaths - batchBegin);
+            // shared, so that the quantities may take paths out of it
+            auto batch = std::make_shared<PathBlock>(observationTimes, batchSize, stateSize);
+            forEachChunk(batchBegin, batchBegin + batchSize, [&](int pathBegin, int pathEnd) {
+                auto brownianSamples = drawBrownianSamples(pathBegin, pathEnd);
+                process.fillObservedPathBlock(brownianSamples.data(), observationIndices, *batch, pathBegin - batchBegin, pathEnd - batchBegin);
+            });
+            // the quantities run on the calling thread only, in path order
+            for (size_t iq = 0; iq < numTargets; ++iq)
+                for (int ip = 0; ip < batchSize; ++ip)
+                    result.statistics[iq].add(targets[iq].quantity(*batch, ip));
+            result.numPaths += batchSize;
+
+            result.isConverged = true;
+            for (size_t iq = 0; iq < numTargets; ++iq)
+                result.isConverged = result.isConverged && result.statistics[iq].getStandardError() <= targets[iq].tolerance;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (result.isConverged || elapsed.count() >= maxSeconds)
+                break;
+        }
+        return result;
+    }
+
+    void MonteCarloEngine::forEachChunk(int begin, int end, const std::function<void(int, int)> & generateChunk) const {
+        int numChunks = (end - begin + PathsPerChunk - 1) / PathsPerChunk;
+
+        // threads pick chunks of paths off a shared counter,
+        // which only changes who generates a path, never how it is generated
+        std::atomic<int> nextChunk(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto worker = [&]() {
+            try {
+                for (int ichunk = nextChunk++; ichunk < numChunks; ichunk = nextChunk++) {
+                    int pathBegin = begin + ichunk * PathsPerChunk;
+                    int pathEnd = std::min(pathBegin + PathsPerChunk, end);
+                    generateChunk(pathBegin, pathEnd);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                nextChunk = numChunks;
+            }
+        };
+
+        int numThreads = std::min(m_numThreads, std::max(numChunks, 1));
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads - 1);
+        for (int ithread = 1; ithread < numThreads; ++ithread)
+            threads.emplace_back(worker);
+        worker();
+        for (auto & thread : threads)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+} // end namespace irm
@@ -0,0 +1,145 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_MONTE_CARLO_ENGINE_H
+#define INTEREST_RATE_MODELLING_MONTE_CARLO_ENGINE_H
+
+#include "fwd_decl.h"
+#include "path_statistics.h"
+#include "philox.h"
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class MonteCarloEngine
+     * Generates many paths of a WienerProcess on several threads.
+     * Every path gets its own random stream, which depends only on the seed and the index of the path,
+     * so the generated paths are bit-identical whatever the number of threads.
+     */
+    class MonteCarloEngine {
+    public:
+
+        /** The type of the random number generator driving each path.
+         * Being counter-based, creating the generator of any path costs nothing.
+         */
+        typedef PhiloxEngine RandomNumberGenerator;
+
+        /** Constructor
+         *
+         * @param process The process to generate paths of.
+         * @param numPaths The number of paths to generate, or the path budget of generateUntilConverged.
+         * @param seed The master seed, from which the stream of every path is derived.
+         * @param numThreads The number of threads to use, 0 meaning one per hardware thread.
+         */
+        MonteCarloEngine(WienerProcessCPtr process, int numPaths, std::uint64_t seed, int numThreads);
+
+        /**
+         * Function to generate all the paths.
+         * @return Returns a block with numPaths paths,
+         *         path i being generated from createPathGenerator(seed, i).
+         */
+        PathBlockCPtr generatePaths() const;
+
+        /**
+         * Function to generate all the paths, keeping only the states at the observation indices.
+         * Each path is streamed through the full time vector, so memory only grows with the observations.
+         * @return Returns a block whose time index i corresponds to observationIndices[i].
+         */
+        PathBlockCPtr generatePaths(const std::vector<int> & observationIndices) const;
+
+        /**
+         * Function to compute the statistics of the states at the observation indices over all the paths,
+         * without keeping the paths: each chunk of paths is accumulated and merged into the result in path order,
+         * so the statistics do not depend on the number of threads.
+         * @return Returns statistics whose time index i corresponds to observationIndices[i].
+         */
+        PathStatistics computeStatistics(const std::vector<int> & observationIndices) const;
+
+        /** Quantity: a value computed from a path of a block, such as a discounted payoff.
+         * Quantities are only called from the thread calling generateUntilConverged, so they need not be thread safe.
+         */
+        typedef std::function< double( const PathBlock & paths, int path ) > Quantity;
+
+        /** A quantity whose mean is estimated, and the standard error at which the estimate is good enough. */
+        struct ConvergenceTarget {
+            Quantity quantity;
+            double tolerance;
+        };
+
+        /** Result of generateUntilConverged. */
+        struct ConvergenceResult {
+            std::vector<RunningStatistics> statistics;  // per target
+            int numPaths;                               // the paths [0, numPaths) were generated
+            bool isConverged;                           // every standard error is within its tolerance
+        };
+
+        /**
+         * Function to generate batches of paths until the means of the targets are known to their tolerance.
+         * Batch k holds paths [k * pathsPerBatch, (k + 1) * pathsPerBatch), generated as by generatePaths
+         * on all the threads; the quantities are then evaluated on the calling thread and accumulated in path order,
+         * so for a given seed the statistics after each batch do not depend on the number of threads.
+         * Generation stops after the first batch where all the standard errors are within tolerance,
+         * or when getNumPaths() paths have been generated, or after the batch exceeding maxSeconds;
+         * only the last criterion depends on the speed of the machine.
+         * @param targets The quantities to estimate the mean of.
+         * @param observationIndices The time indices of the states the quantities see,
+         *        time index i of the blocks passed to the quantities corresponding to observationIndices[i].
+         * @param pathsPerBatch The number of paths generated between two convergence checks.
+         * @param maxSeconds The wall clock budget, checked between batches.
+         */
+        ConvergenceResult generateUntilConverged(
+                const std::vector<ConvergenceTarget> & targets,
+                const std::vector<int> & observationIndices,
+                int pathsPerBatch,
+                double maxSeconds = std::numeric_limits<double>::infinity()) const;
+
+        /** The random number generator for the path at pathIndex under the given master seed. */
+        static RandomNumberGenerator createPathGenerator(std::uint64_t seed, std::int64_t pathIndex);
+
+        int getNumPaths() const { return m_numPaths; }
+        int getNumThreads() const { return m_numThreads; }
+
+    private:
+        // the normals of paths [pathBegin, pathEnd), laid out as [sample][path - pathBegin]
+        std::vector<double> drawBrownianSamples(int pathBegin, int pathEnd) const;
+        // calls generateChunk(pathBegin, pathEnd) over the paths [begin, end), on all the threads
+        void forEachChunk(int begin, int end, const std::function<void(int, int)> & generateChunk) const;
+
+        WienerProcessCPtr m_process;
+        int m_numPaths;
+        std::uint64_t m_seed;
+        int m_numThreads;
+    }; // end class MonteCarloEngine
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_MONTE_CARLO_ENGINE_H
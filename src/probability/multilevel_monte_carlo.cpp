@@ -0,0 +1,218 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "multilevel_monte_carlo.h"
+
+#include "normal_sampler.h"
+#include "path_block.h"
+#include "philox.h"
+#include "time.h"
+#include "time_grid.h"
+#include "wiener_process.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+    // number of paths generated at once within a level
+    const int PathsPerBatch = 256;
+
+} // end anonymous namespace
+
+namespace irm {
+
+    MultilevelMonteCarlo::MultilevelMonteCarlo(
+            WienerProcessCPtr process,
+            Payoff payoff,
+            int numCoarsestSteps,
+            std::uint64_t seed):
+            m_process(process),
+            m_payoff(std::move(payoff)),
+            m_numCoarsestSteps(numCoarsestSteps),
+            m_seed(seed),
+            m_levelProcesses()
+    {
+        if (!m_process || !m_payoff)
+            throw std::invalid_argument("MultilevelMonteCarlo: null process or payoff");
+        if (numCoarsestSteps < 1)
+            throw std::invalid_argument("MultilevelMonteCarlo: the coarsest level needs at least one step");
+        if (m_process->getTimeGrid()->getNumTimes() < 2)
+            throw std::invalid_argument("MultilevelMonteCarlo: the time vector of the process must span an interval");
+    }
+
+    WienerProcessCPtr MultilevelMonteCarlo::getLevelProcess(int level) const {
+        std::lock_guard<std::mutex> lock(m_levelProcessesMutex);
+        const ITimeGrid & timeGrid = *m_process->getTimeGrid();
+        Time start = timeGrid.getTimeAtIndex(0);
+        Time end = timeGrid.getTimeAtIndex(timeGrid.getNumTimes() - 1);
+        while (static_cast<int>(m_levelProcesses.size()) <= level) {
+            int numSteps = m_numCoarsestSteps << m_levelProcesses.size();
+            auto process = m_process->createOnTimeVector(ITimeVector::createUniform(start, (end - start) / numSteps, numSteps + 1));
+            // the coupling sums fine increments in time order
+            process->setPathConstruction(WienerProcess::PathConstruction::Incremental);
+            m_levelProcesses.push_back(process);
+        }
+        return m_levelProcesses[level];
+    }
+
+    std::vector<double> MultilevelMonteCarlo::sampleLevel(int level, std::int64_t pathBegin, int numPaths) const {
+        auto fine = getLevelProcess(level);
+        int numFineSamples = fine->getRequiredNumberOfSamples();
+        std::vector<double> fineNormals(static_cast<size_t>(numFineSamples) * numPaths);
+        for (int ip = 0; ip < numPaths; ++ip) {
+            PhiloxEngine rng(m_seed, (static_cast<std::uint64_t>(level) << 40) + pathBegin + ip);
+            NormalSampler::fill(rng, fineNormals.data() + static_cast<size_t>(ip) * numFineSamples, numFineSamples);
+        }
+        auto fineBlock = fine->generatePathsFromNormals(fineNormals, numPaths);
+        std::vector<double> samples(numPaths);
+        for (int ip = 0; ip < numPaths; ++ip)
+            samples[ip] = m_payoff(*fineBlock, ip);
+        if (level == 0)
+            return samples;
+
+        // each coarse increment is the sum of the two fine increments it spans
+        auto coarse = getLevelProcess(level - 1);
+        const ITimeGrid & fineGrid = *fine->getTimeGrid();
+        const ITimeGrid & coarseGrid = *coarse->getTimeGrid();
+        int numFactors = fine->getNumFactors();
+        int numCoarseSteps = coarseGrid.getNumTimes() - 1;
+        int numCoarseSamples = coarse->getRequiredNumberOfSamples();
+        std::vector<double> coarseNormals(static_cast<size_t>(numCoarseSamples) * numPaths);
+        for (int ip = 0; ip < numPaths; ++ip) {
+            const double * z = fineNormals.data() + static_cast<size_t>(ip) * numFineSamples;
+            double * coarseZ = coarseNormals.data() + static_cast<size_t>(ip) * numCoarseSamples;
+            for (int k = 0; k < numCoarseSteps; ++k) {
+                double sqrtDt0 = fineGrid.getSqrtDtAtIndex(2 * k + 1);
+                double sqrtDt1 = fineGrid.getSqrtDtAtIndex(2 * k + 2);
+                double coarseSqrtDt = coarseGrid.getSqrtDtAtIndex(k + 1);
+                for (int f = 0; f < numFactors; ++f) {
+                    double dW = z[(2 * k) * numFactors + f] * sqrtDt0 + z[(2 * k + 1) * numFactors + f] * sqrtDt1;
+                    coarseZ[k * numFactors + f] = dW / coarseSqrtDt;
+                }
+            }
+        }
+        auto coarseBlock = coarse->generatePathsFromNormals(coarseNormals, numPaths);
+        for (int ip = 0; ip < numPaths; ++ip)
+            samples[ip] -= m_payoff(*coarseBlock, ip);
+        return samples;
+    }
+
+    MultilevelMonteCarlo::Result MultilevelMonteCarlo::estimate(
+            double rmse,
+            int minLevels,
+            int maxLevels,
+            std::int64_t numInitialPaths) const
+    {
+        if (rmse <= 0 || minLevels < 1 || maxLevels < minLevels || numInitialPaths < 2)
+            throw std::invalid_argument("MultilevelMonteCarlo: invalid estimation settings");
+
+        std::vector<std::int64_t> numPaths, numNewPaths;
+        std::vector<double> sums, sumSquares, costs;
+        auto addLevel = [&]() {
+            int level = numPaths.size();
+            numPaths.push_back(0);
+            numNewPaths.push_back(numInitialPaths);
+            sums.push_back(0);
+            sumSquares.push_back(0);
+            // fine and coarse steps of a sample
+            costs.push_back(static_cast<double>(m_numCoarsestSteps << level) * (level == 0 ? 1 : 1.5));
+        };
+        for (int l = 0; l < minLevels; ++l)
+            addLevel();
+
+        std::vector<double> means, variances;
+        while (true) {
+            // sample the paths still needed
+            for (size_t l = 0; l < numPaths.size(); ++l) {
+                for (std::int64_t done = 0; done < numNewPaths[l]; done += PathsPerBatch) {
+                    int batchSize = static_cast<int>(std::min<std::int64_t>(PathsPerBatch, numNewPaths[l] - done));
+                    for (double y : sampleLevel(l, numPaths[l] + done, batchSize)) {
+                        sums[l] += y;
+                        sumSquares[l] += y * y;
+                    }
+                }
+                numPaths[l] += numNewPaths[l];
+                numNewPaths[l] = 0;
+            }
+            int numLevels = numPaths.size();
+            means.assign(numLevels, 0.0);
+            variances.assign(numLevels, 0.0);
+            for (int l = 0; l < numLevels; ++l) {
+                means[l] = sums[l] / numPaths[l];
+                variances[l] = std::max(sumSquares[l] / numPaths[l] - means[l] * means[l], 0.0);
+            }
+
+            // numbers of paths minimizing the cost for a variance of rmse^2 / 2
+            double sumSqrtVarianceCost = 0;
+            for (int l = 0; l < numLevels; ++l)
+                sumSqrtVarianceCost += std::sqrt(variances[l] * costs[l]);
+            bool isSampled = true;
+            for (int l = 0; l < numLevels; ++l) {
+                double optimal = std::ceil(2 / (rmse * rmse) * std::sqrt(variances[l] / costs[l]) * sumSqrtVarianceCost);
+                numNewPaths[l] = std::max<std::int64_t>(0, static_cast<std::int64_t>(optimal) - numPaths[l]);
+                isSampled = isSampled && numNewPaths[l] <= numPaths[l] / 100;
+            }
+            if (!isSampled)
+                continue;
+            // the bias is extrapolated from two levels, so a single one is only kept if no more are allowed
+            if (numLevels < 2) {
+                if (numLevels >= maxLevels)
+                    break;
+                addLevel();
+                continue;
+            }
+
+            // the weak order alpha, |E[P_l - P_{l-1}]| ~ 2^(-alpha l), fitted on the levels above 0
+            double alpha = 1;
+            if (numLevels >= 3) {
+                double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+                for (int l = 1; l < numLevels; ++l) {
+                    double y = std::log2(std::max(std::abs(means[l]), 1e-300));
+                    n += 1; sx += l; sy += y; sxx += l * l; sxy += l * y;
+                }
+                alpha = std::max(.5, -(n * sxy - sx * sy) / (n * sxx - sx * sx));
+            }
+            // the remaining bias E[P - P_L], extrapolated from the last two levels
+            double refinement = std::pow(2.0, alpha);
+            double lastMean = std::max(std::abs(means[numLevels - 1]), std::abs(means[numLevels - 2]) / refinement);
+            double bias = lastMean / (refinement - 1);
+            if (bias <= rmse / std::sqrt(2.0) || numLevels >= maxLevels)
+                break;
+            addLevel();
+        }
+
+        Result result{ 0, 0, numPaths, means, variances, 0 };
+        double errorVariance = 0;
+        for (size_t l = 0; l < numPaths.size(); ++l) {
+            result.estimate += means[l];
+            errorVariance += variances[l] / numPaths[l];
+            result.cost += costs[l] * numPaths[l];
+        }
+        result.standardError = std::sqrt(errorVariance);
+        return result;
+    }
+
+} // end namespace irm
@@ -0,0 +1,112 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_MULTILEVEL_MONTE_CARLO_H
+#define INTEREST_RATE_MODELLING_MULTILEVEL_MONTE_CARLO_H
+
+#include "fwd_decl.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class MultilevelMonteCarlo
+     * Estimates the expectation of a payoff of the paths of a WienerProcess by multilevel Monte Carlo (Giles, 2008).
+     * Level l runs the same process on a uniform time grid of numCoarsestSteps * 2^l steps,
+     *   spanning the time vector of the process.
+     * E[P_L] is estimated as E[P_0] + sum_l E[P_l - P_{l-1}], where each sample of P_l - P_{l-1}
+     *   comes from a fine and a coarse path coupled by sharing the same brownian path:
+     *   each coarse increment is the sum of the two fine increments it spans.
+     * The number of paths of each level is chosen from online estimates of the variance and cost of the levels,
+     *   and levels are added until the estimated bias is small enough,
+     *   so that a target root mean square error eps costs about O(eps^-2) instead of O(eps^-3).
+     * The paths of each level are built incrementally, whatever the path construction of the process.
+     */
+    class MultilevelMonteCarlo {
+    public:
+
+        /** Payoff: the value of the payoff on a path of a block.
+         * It must only depend on the time vector of the block through its times,
+         *   as fine and coarse paths are on different time grids.
+         */
+        typedef std::function< double( const PathBlock & paths, int path ) > Payoff;
+
+        /** Result of an estimation. */
+        struct Result {
+            double estimate;                     // sum of the level means
+            double standardError;                // sqrt(sum_l variance_l / numPaths_l)
+            std::vector<std::int64_t> numPaths;  // per level
+            std::vector<double> means;           // of P_0 and P_l - P_{l-1}, per level
+            std::vector<double> variances;       // per level
+            double cost;                         // total number of fine and coarse steps simulated
+        };
+
+        /** Constructor
+         *
+         * @param process The process defining the variables, generated on the time grid of each level.
+         * @param payoff The payoff to estimate the expectation of.
+         * @param numCoarsestSteps The number of steps of level 0.
+         * @param seed The master seed; path i of level l is driven by PhiloxEngine(seed, (l << 40) + i).
+         */
+        MultilevelMonteCarlo(WienerProcessCPtr process, Payoff payoff, int numCoarsestSteps, std::uint64_t seed);
+
+        /**
+         * Function to estimate the expectation of the payoff
+         * @param rmse The target root mean square error, half of its square going to the variance,
+         *             half to the bias.
+         * @param minLevels The least number of levels.
+         * @param maxLevels The most number of levels, the bias target being given up beyond.
+         * @param numInitialPaths The number of paths of a new level, to estimate its variance.
+         */
+        Result estimate(double rmse, int minLevels = 3, int maxLevels = 10, std::int64_t numInitialPaths = 1000) const;
+
+        /**
+         * Function to sample P_l - P_{l-1} (or P_0 at level 0) on paths [pathBegin, pathBegin + numPaths) of a level
+         * @return Returns one sample per path, in path order.
+         */
+        std::vector<double> sampleLevel(int level, std::int64_t pathBegin, int numPaths) const;
+
+        /** The process of the given level. */
+        WienerProcessCPtr getLevelProcess(int level) const;
+
+    private:
+
+        WienerProcessCPtr m_process;
+        Payoff m_payoff;
+        int m_numCoarsestSteps;
+        std::uint64_t m_seed;
+        mutable std::vector<WienerProcessCPtr> m_levelProcesses;  // created on first use
+        mutable std::mutex m_levelProcessesMutex;
+    }; // end class MultilevelMonteCarlo
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_MULTILEVEL_MONTE_CARLO_H
@@ -0,0 +1,123 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_NORMAL_SAMPLER_H
+#define INTEREST_RATE_MODELLING_NORMAL_SAMPLER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace irm {
+
+
+    /**
+     * class NormalSampler
+     * Generates standard normal samples in bulk, by inversion of the normal cumulative distribution.
+     * Every normal consumes exactly one uniform, without rejection,
+     * so a span of normals is a pure function of the same span of uniforms:
+     *   filling n normals at once or in several calls gives the same numbers.
+     */
+    class NormalSampler {
+    public:
+
+        /** Inverse of the standard normal cumulative distribution (Wichura's AS241, ~1e-16 relative accuracy).
+         * @param u A probability in the open interval (0, 1).
+         */
+        static double inverseCumulative(double u);
+
+        /** Replace each of the n uniforms in (0, 1) by its inverse cumulative normal, in place. */
+        static void uniformsToNormals(double * values, std::size_t n);
+
+        /** Map 64 random bits to a uniform in the open interval (0, 1). */
+        static double bitsToUniform(std::uint64_t bits) {
+            return (static_cast<double>(bits >> 11) + .5) * (1.0 / 9007199254740992.0);
+        }
+
+        /** Fill out with n standard normals drawn from the random number generator. */
+        template<typename RandomNumberGenerator>
+        static void fill(RandomNumberGenerator & rng, double * out, std::size_t n);
+
+        /** Same as fill, but writing the i-th normal to out[i * stride]. */
+        template<typename RandomNumberGenerator>
+        static void fillStrided(RandomNumberGenerator & rng, double * out, std::size_t n, std::size_t stride);
+
+    private:
+        static constexpr std::size_t BatchSize = 256;
+    }; // end class NormalSampler
+
+
+    template<typename RandomNumberGenerator>
+    void NormalSampler::fill(RandomNumberGenerator & rng, double * out, std::size_t n)
+    {
+        constexpr bool hasFullRange =
+                RandomNumberGenerator::min() == 0
+                && RandomNumberGenerator::max() == std::numeric_limits<std::uint64_t>::max();
+        constexpr bool hasBulkFill = requires(RandomNumberGenerator & r, std::uint64_t * bits, std::size_t size) {
+            r.fill(bits, size);
+        };
+
+        if constexpr (hasFullRange && hasBulkFill) {
+            // counter-based generators produce the random bits of a whole batch at once
+            std::uint64_t bits[BatchSize];
+            for (std::size_t begin = 0; begin < n; begin += BatchSize) {
+                std::size_t size = std::min(BatchSize, n - begin);
+                rng.fill(bits, size);
+                for (std::size_t i = 0; i < size; ++i)
+                    out[begin + i] = bitsToUniform(bits[i]);
+            }
+        } else if constexpr (hasFullRange) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = bitsToUniform(rng());
+        } else {
+            // narrower generators (eg. std::default_random_engine) need several draws per uniform
+            const double smallest = std::numeric_limits<double>::epsilon() / 4;
+            for (std::size_t i = 0; i < n; ++i) {
+                double u = std::generate_canonical<double, std::numeric_limits<double>::digits>(rng);
+                out[i] = std::clamp(u, smallest, 1 - smallest);
+            }
+        }
+        uniformsToNormals(out, n);
+    }
+
+
+    template<typename RandomNumberGenerator>
+    void NormalSampler::fillStrided(RandomNumberGenerator & rng, double * out, std::size_t n, std::size_t stride)
+    {
+        double normals[BatchSize];
+        for (std::size_t begin = 0; begin < n; begin += BatchSize) {
+            std::size_t size = std::min(BatchSize, n - begin);
+            fill(rng, normals, size);
+            for (std::size_t i = 0; i < size; ++i)
+                out[(begin + i) * stride] = normals[i];
+        }
+    }
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_NORMAL_SAMPLER_H
@@ -27,21 +27,90 @@ SOFTWARE.
 #include "time.h"
 #include "state.h"
 
+#include <stdexcept>
+
 
 namespace {
 
     using namespace irm;
 
-    class PathFromStateVector : public IPath {
+    void checkTimeIndex(int timeIndex, int numTimes) {
+        if (timeIndex < 0 || timeIndex >= numTimes)
+            throw std::out_of_range("IPath: time index out of range");
+    }
+
+    /**
+     * Path keeping all its states in a single numTimes x stateSize buffer.
+     * The states handed out are views into that buffer, made on each call.
+     */
+    class PathFromFlatBuffer : public IPath {
+    public:
+
+        PathFromFlatBuffer(
+                ITimeVectorCPtr timeVector,
+                int stateSize,
+                PathLayout layout,
+                std::vector<double> values) :
+                m_timeVector(timeVector),
+                m_stateSize(stateSize),
+                m_values(std::move(values)),
+                m_timeStride(layout == PathLayout::RowMajor ? stateSize : 1),
+                m_valueStride(layout == PathLayout::RowMajor ? 1 : timeVector->getNumTimes())
+        { }
+
+        int getNumTimes() const override {
+            return m_timeVector->getNumTimes();
+        }
+
+        int getStateSize() const override {
+            return m_stateSize;
+        }
+
+        Time getTimeAtIndex(int timeIndex) const override {
+            return m_timeVector->getTimeAtIndex(timeIndex);
+        }
+
+        const StateView getStateAtIndex(int timeIndex) const override {
+            return const_cast<PathFromFlatBuffer *>(this)->getStateAtIndex(timeIndex);
+        }
+
+        StateView getStateAtIndex(int timeIndex) override {
+            checkTimeIndex(timeIndex, m_timeVector->getNumTimes());
+            return StateView(m_values.data() + static_cast<size_t>(timeIndex) * m_timeStride, m_stateSize, m_valueStride);
+        }
+
+    private:
+        ITimeVectorCPtr m_timeVector;
+        int m_stateSize;
+        std::vector<double> m_values;
+        int m_timeStride;
+        int m_valueStride;
+    }; // end class PathFromFlatBuffer
+
+
+    /**
+     * Path viewing values owned by some other object.
+     * The owner is held on to for as long as the view lives.
+     * A read-only view refuses mutable access to its states.
+     */
+    class PathView : public IPath {
     public:
 
-        PathFromStateVector(
+        PathView(
                 ITimeVectorCPtr timeVector,
                 int stateSize,
-                std::vector<IStatePtr> stateVector) :
+                double * data,
+                int timeStride,
+                int valueStride,
+                std::shared_ptr<const void> owner,
+                bool isReadOnly) :
                 m_timeVector(timeVector),
                 m_stateSize(stateSize),
-                m_stateVector(std::move(stateVector))
+                m_data(data),
+                m_timeStride(timeStride),
+                m_valueStride(valueStride),
+                m_owner(std::move(owner)),
+                m_isReadOnly(isReadOnly)
         { }
 
         int getNumTimes() const override {
@@ -56,32 +125,65 @@ namespace {
             return m_timeVector->getTimeAtIndex(timeIndex);
         }
 
-        const IState & getStateAtIndex(int timeIndex) const override {
-            return *m_stateVector.at(timeIndex);
+        const StateView getStateAtIndex(int timeIndex) const override {
+            checkTimeIndex(timeIndex, m_timeVector->getNumTimes());
+            return StateView(m_data + static_cast<size_t>(timeIndex) * m_timeStride, m_stateSize, m_valueStride);
         }
 
-        IState & getStateAtIndex(int timeIndex) override {
-            return *m_stateVector.at(timeIndex);
+        StateView getStateAtIndex(int timeIndex) override {
+            if (m_isReadOnly)
+                throw std::logic_error("PathView: the values of a read-only view cannot be modified");
+            return static_cast<const PathView *>(this)->getStateAtIndex(timeIndex);
         }
 
     private:
         ITimeVectorCPtr m_timeVector;
         int m_stateSize;
-        std::vector<IStatePtr> m_stateVector;
-    }; // end class PathVectorImpl
+        double * m_data;
+        int m_timeStride;
+        int m_valueStride;
+        std::shared_ptr<const void> m_owner;
+        bool m_isReadOnly;
+    }; // end class PathView
 
 } // end anonymous namespace
 
 
 namespace irm {
 
-    IPathPtr IPath::createZeroPath(ITimeVectorCPtr timeVector, int stateSize) {
-        int numTimes = timeVector->getNumTimes();
-        std::vector<IStatePtr> stateVector;
-        stateVector.reserve(numTimes);
-        for (int i = 0; i < numTimes; ++i)
-            stateVector.push_back(IState::createZeroState(stateSize));
-        return std::make_shared<PathFromStateVector>(timeVector, stateSize, stateVector);
+    IPathPtr IPath::createZeroPath(ITimeVectorCPtr timeVector, int stateSize, PathLayout layout) {
+        std::vector<double> values(static_cast<size_t>(timeVector->getNumTimes()) * stateSize, 0.0);
+        return std::make_shared<PathFromFlatBuffer>(timeVector, stateSize, layout, std::move(values));
+    }
+
+    IPathPtr IPath::createFromValues(ITimeVectorCPtr timeVector, int stateSize, std::vector<double> values) {
+        if (values.size() != static_cast<size_t>(timeVector->getNumTimes()) * stateSize)
+            throw std::invalid_argument("IPath::createFromValues: expected numTimes x stateSize values");
+        return std::make_shared<PathFromFlatBuffer>(timeVector, stateSize, PathLayout::RowMajor, std::move(values));
+    }
+
+    IPathPtr IPath::createView(
+            ITimeVectorCPtr timeVector,
+            int stateSize,
+            double * data,
+            int timeStride,
+            int valueStride,
+            std::shared_ptr<const void> owner)
+    {
+        return std::make_shared<PathView>(timeVector, stateSize, data, timeStride, valueStride, std::move(owner), false);
+    }
+
+    IPathCPtr IPath::createView(
+            ITimeVectorCPtr timeVector,
+            int stateSize,
+            const double * data,
+            int timeStride,
+            int valueStride,
+            std::shared_ptr<const void> owner)
+    {
+        // the view is read-only, so the values are never written through the cast away constness
+        double * values = const_cast<double *>(data);
+        return std::make_shared<PathView>(timeVector, stateSize, values, timeStride, valueStride, std::move(owner), true);
     }
 
 } // end namespace irm
\ No newline at end of file
@@ -26,19 +26,63 @@ SOFTWARE.
 #define INTEREST_RATE_MODELLING_PATH_H
 
 #include "fwd_decl.h"
+#include "state.h"
+
+#include <vector>
 
 namespace irm {
 
+    /**
+     * Memory layout of the values of a path.
+     * RowMajor keeps each state contiguous,
+     * ColumnMajor keeps the values of each state variable contiguous across time.
+     */
+    enum class PathLayout {
+        RowMajor,
+        ColumnMajor
+    };
+
     class IPath {
     public:
 
         virtual int getNumTimes() const = 0;
         virtual int getStateSize() const = 0;
         virtual Time getTimeAtIndex(int timeIndex) const = 0;
-        virtual const IState & getStateAtIndex(int timeIndex) const = 0;
-        virtual IState & getStateAtIndex(int timeIndex) = 0;
+        // states are views into the values of the path, made on demand rather than stored per time point
+        virtual const StateView getStateAtIndex(int timeIndex) const = 0;
+        virtual StateView getStateAtIndex(int timeIndex) = 0;
+
+        static IPathPtr createZeroPath(ITimeVectorCPtr timeVector, int stateSize, PathLayout layout = PathLayout::RowMajor);
+
+        /** Function to create a path owning the given row-major numTimes x stateSize values. */
+        static IPathPtr createFromValues(ITimeVectorCPtr timeVector, int stateSize, std::vector<double> values);
+
+        /** Function to create a path over values owned by someone else, without copying them.
+         *
+         * @param data The value of the first state variable at the first time point.
+         * @param timeStride Distance (in doubles) between consecutive states of the path.
+         * @param valueStride Distance (in doubles) between consecutive values of a state.
+         * @param owner Kept alive for as long as the returned path lives.
+         */
+        static IPathPtr createView(
+                ITimeVectorCPtr timeVector,
+                int stateSize,
+                double * data,
+                int timeStride,
+                int valueStride,
+                std::shared_ptr<const void> owner);
 
-        static IPathPtr createZeroPath(ITimeVectorCPtr timeVector, int stateSize);
+        /** Function to create a read-only path over values owned by someone else, without copying them.
+         *
+         * Parameters as for the mutable view; the values are never written.
+         */
+        static IPathCPtr createView(
+                ITimeVectorCPtr timeVector,
+                int stateSize,
+                const double * data,
+                int timeStride,
+                int valueStride,
+                std::shared_ptr<const void> owner);
     }; // end class IPath
 
 } // end namespace irm
@@ -0,0 +1,58 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "path_block.h"
+
+#include "path.h"
+#include "time.h"
+
+namespace irm {
+
+    PathBlock::PathBlock(ITimeVectorCPtr timeVector, int numPaths, int stateSize) :
+            m_timeVector(timeVector),
+            m_numPaths(numPaths),
+            m_numTimes(timeVector->getNumTimes()),
+            m_stateSize(stateSize),
+            m_values(static_cast<size_t>(m_numTimes) * stateSize * numPaths, 0.0)
+    { }
+
+    Time PathBlock::getTimeAtIndex(int timeIndex) const {
+        return m_timeVector->getTimeAtIndex(timeIndex);
+    }
+
+    StateView PathBlock::getState(int pathIndex, int timeIndex) {
+        return StateView(m_values.data() + offset(timeIndex, StateVariable(0)) + pathIndex, m_stateSize, m_numPaths);
+    }
+
+    IPathCPtr PathBlock::getPath(int pathIndex) const {
+        return IPath::createView(
+                m_timeVector,
+                m_stateSize,
+                m_values.data() + pathIndex,
+                m_stateSize * m_numPaths,
+                m_numPaths,
+                shared_from_this());
+    }
+
+} // end namespace irm
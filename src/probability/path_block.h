@@ -0,0 +1,84 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_PATH_BLOCK_H
+#define INTEREST_RATE_MODELLING_PATH_BLOCK_H
+
+#include "fwd_decl.h"
+#include "state.h"
+
+#include <vector>
+
+namespace irm {
+
+    /**
+     * class PathBlock
+     * A set of paths sharing one time vector, stored in a single allocation.
+     * Values are laid out as [time][state variable][path], i.e. with the path index innermost,
+     * so that the values of one state variable at one time point are contiguous across all paths.
+     */
+    class PathBlock : public std::enable_shared_from_this<PathBlock> {
+    public:
+
+        PathBlock(ITimeVectorCPtr timeVector, int numPaths, int stateSize);
+
+        int getNumPaths() const { return m_numPaths; }
+        int getNumTimes() const { return m_numTimes; }
+        int getStateSize() const { return m_stateSize; }
+        Time getTimeAtIndex(int timeIndex) const;
+        const ITimeVectorCPtr & getTimeVector() const { return m_timeVector; }
+
+        double getValue(int pathIndex, int timeIndex, StateVariable x) const {
+            return m_values[offset(timeIndex, x) + pathIndex];
+        }
+
+        void setValue(int pathIndex, int timeIndex, StateVariable x, double value) {
+            m_values[offset(timeIndex, x) + pathIndex] = value;
+        }
+
+        /** The values of variable x at timeIndex for all paths, contiguous. */
+        const double * getValues(int timeIndex, StateVariable x) const { return m_values.data() + offset(timeIndex, x); }
+        double * getValues(int timeIndex, StateVariable x) { return m_values.data() + offset(timeIndex, x); }
+
+        /** View of the state of one path at one time point. */
+        StateView getState(int pathIndex, int timeIndex);
+
+        /** Path view into this block. The view keeps the block alive. */
+        IPathCPtr getPath(int pathIndex) const;
+
+    private:
+        size_t offset(int timeIndex, StateVariable x) const {
+            return (static_cast<size_t>(timeIndex) * m_stateSize + x.index) * m_numPaths;
+        }
+
+        ITimeVectorCPtr m_timeVector;
+        int m_numPaths;
+        int m_numTimes;
+        int m_stateSize;
+        std::vector<double> m_values;
+    }; // end class PathBlock
+
+} // end namespace irm
+
+#endif //INTEREST_RATE_MODELLING_PATH_BLOCK_H
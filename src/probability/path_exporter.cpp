@@ -0,0 +1,261 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "path_exporter.h"
+
+#include "path.h"
+#include "path_block.h"
+#include "time.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    template <typename T>
+    void writeRaw(std::ofstream & file, const T * data, size_t n) {
+        file.write(reinterpret_cast<const char *>(data), n * sizeof(T));
+    }
+
+    // shortest representation that reads back to the same double
+    char * appendNumber(char * out, char * end, double value) {
+        return std::to_chars(out, end, value).ptr;
+    }
+
+} // end anonymous namespace
+
+namespace irm {
+
+    PathExporter::PathExporter(
+            const std::string & fileName,
+            Format format,
+            ITimeVectorCPtr timeVector,
+            std::vector<int> timeIndices,
+            std::vector<StateVariable> variables,
+            const std::vector<std::string> & variableNames,
+            int pathsPerBuffer):
+            m_file(),
+            m_format(format),
+            m_numTimes(timeVector ? timeVector->getNumTimes() : 0),
+            m_stateSize(0),
+            m_columns(),
+            m_pathsPerBuffer(pathsPerBuffer)
+    {
+        if (!timeVector || timeIndices.empty() || variables.empty())
+            throw std::invalid_argument("PathExporter: nothing to export");
+        if (variableNames.size() != variables.size())
+            throw std::invalid_argument("PathExporter: every variable needs a name");
+        if (pathsPerBuffer < 1)
+            throw std::invalid_argument("PathExporter: buffers need room for a path");
+        for (size_t iv = 0; iv < variables.size(); ++iv) {
+            m_stateSize = std::max(m_stateSize, variables[iv].index + 1);
+            for (int it : timeIndices) {
+                if (it < 0 || it >= m_numTimes)
+                    throw std::invalid_argument("PathExporter: time index out of the time vector");
+                std::string name = variableNames[iv] + "@";
+                char time[32];
+                name.append(time, appendNumber(time, time + sizeof(time), timeVector->getTimeAtIndex(it)));
+                m_columns.push_back(Column{it, variables[iv], name});
+            }
+        }
+        m_file.open(fileName, std::ios::binary | std::ios::trunc);
+        if (!m_file)
+            throw std::runtime_error("PathExporter: cannot open " + fileName);
+        writeHeader(*timeVector);
+        if (!m_file)
+            throw std::runtime_error("PathExporter: write failed");
+
+        m_filling.values.resize(m_columns.size() * m_pathsPerBuffer);
+        m_writing.values.resize(m_columns.size() * m_pathsPerBuffer);
+        m_writer = std::thread([this]() { runWriter(); });
+    }
+
+    PathExporter::~PathExporter() {
+        try {
+            close();
+        } catch (...) {
+            // destructors must not throw: call close() to see write errors
+        }
+    }
+
+    std::int64_t PathExporter::getNumPaths() const {
+        std::lock_guard<std::mutex> lock(m_fillMutex);
+        return m_filling.firstPath + m_filling.numRows;
+    }
+
+    void PathExporter::exportPath(const IPath & path) {
+        if (path.getNumTimes() != m_numTimes || path.getStateSize() < m_stateSize)
+            throw std::invalid_argument("PathExporter: path does not match the exported time vector or variables");
+        std::lock_guard<std::mutex> lock(m_fillMutex);
+        if (m_failure)
+            std::rethrow_exception(m_failure);
+        for (size_t ic = 0; ic < m_columns.size(); ++ic) {
+            const Column & column = m_columns[ic];
+            m_filling.values[ic * m_pathsPerBuffer + m_filling.numRows] =
+                    path.getStateAtIndex(column.timeIndex).getValue(column.variable);
+        }
+        if (++m_filling.numRows == m_pathsPerBuffer)
+            handOver();
+    }
+
+    void PathExporter::exportPaths(const PathBlock & paths) {
+        if (paths.getNumTimes() != m_numTimes || paths.getStateSize() < m_stateSize)
+            throw std::invalid_argument("PathExporter: paths do not match the exported time vector or variables");
+        std::lock_guard<std::mutex> lock(m_fillMutex);
+        if (m_failure)
+            std::rethrow_exception(m_failure);
+        int numPaths = paths.getNumPaths();
+        for (int pathBegin = 0; pathBegin < numPaths; ) {
+            // the block holds every column contiguously across paths
+            int numRows = std::min(numPaths - pathBegin, m_pathsPerBuffer - m_filling.numRows);
+            for (size_t ic = 0; ic < m_columns.size(); ++ic) {
+                const Column & column = m_columns[ic];
+                std::memcpy(
+                        m_filling.values.data() + ic * m_pathsPerBuffer + m_filling.numRows,
+                        paths.getValues(column.timeIndex, column.variable) + pathBegin,
+                        numRows * sizeof(double));
+            }
+            pathBegin += numRows;
+            m_filling.numRows += numRows;
+            if (m_filling.numRows == m_pathsPerBuffer)
+                handOver();
+        }
+    }
+
+    void PathExporter::close() {
+        std::lock_guard<std::mutex> fillLock(m_fillMutex);
+        if (!m_writer.joinable())
+            return;
+        if (m_filling.numRows > 0 && !m_failure) {
+            try {
+                handOver();
+            } catch (...) {
+                // reported below
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isClosing = true;
+        }
+        m_condition.notify_all();
+        m_writer.join();
+        m_file.close();
+        if (m_error)
+            std::rethrow_exception(m_error);
+        if (m_file.fail())
+            throw std::runtime_error("PathExporter: write failed");
+    }
+
+    void PathExporter::handOver() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return !m_isWriting; });
+        if (m_error) {
+            // the rows can no longer be written: drop them and fail every later export
+            m_failure = m_error;
+            m_filling.numRows = 0;
+            std::rethrow_exception(m_failure);
+        }
+        std::swap(m_filling, m_writing);
+        m_isWriting = true;
+        lock.unlock();
+        m_condition.notify_all();
+        m_filling.firstPath = m_writing.firstPath + m_writing.numRows;
+        m_filling.numRows = 0;
+    }
+
+    void PathExporter::runWriter() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [this]() { return m_isWriting || m_isClosing; });
+            if (!m_isWriting)
+                return;
+            // the exporting threads leave m_writing alone until m_isWriting is reset
+            lock.unlock();
+            try {
+                if (!m_error)
+                    writeBuffer(m_writing);
+            } catch (...) {
+                lock.lock();
+                m_error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            m_isWriting = false;
+            m_condition.notify_all();
+        }
+    }
+
+    void PathExporter::writeHeader(const ITimeVector & timeVector) {
+        if (m_format == Format::Csv) {
+            m_file << "path";
+            for (const Column & column : m_columns)
+                m_file << ',' << column.name;
+            m_file << '\n';
+            return;
+        }
+        std::uint32_t numColumns = m_columns.size(), reserved = 0;
+        m_file.write("IRMCOLS1", 8);
+        writeRaw(m_file, &numColumns, 1);
+        writeRaw(m_file, &reserved, 1);
+        for (const Column & column : m_columns) {
+            double t = timeVector.getTimeAtIndex(column.timeIndex);
+            std::uint32_t index = column.variable.index, length = column.name.size();
+            writeRaw(m_file, &t, 1);
+            writeRaw(m_file, &index, 1);
+            writeRaw(m_file, &length, 1);
+            writeRaw(m_file, column.name.data(), length);
+        }
+    }
+
+    void PathExporter::writeBuffer(const Buffer & buffer) {
+        if (m_format == Format::BinaryColumns) {
+            std::uint64_t numRows = buffer.numRows;
+            writeRaw(m_file, &numRows, 1);
+            for (size_t ic = 0; ic < m_columns.size(); ++ic)
+                writeRaw(m_file, buffer.values.data() + ic * m_pathsPerBuffer, buffer.numRows);
+        } else {
+            // the buffer is encoded into one string, rather than streamed value by value
+            std::string text;
+            char number[32];
+            for (int ir = 0; ir < buffer.numRows; ++ir) {
+                auto result = std::to_chars(number, number + sizeof(number), buffer.firstPath + ir);
+                text.append(number, result.ptr);
+                for (size_t ic = 0; ic < m_columns.size(); ++ic) {
+                    text.push_back(',');
+                    text.append(number, appendNumber(number, number + sizeof(number), buffer.values[ic * m_pathsPerBuffer + ir]));
+                }
+                text.push_back('\n');
+            }
+            m_file.write(text.data(), text.size());
+        }
+        // errors surface with the buffer that caused them, not some buffers later
+        m_file.flush();
+        if (!m_file)
+            throw std::runtime_error("PathExporter: write failed");
+    }
+
+} // end namespace irm
@@ -0,0 +1,145 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_PATH_EXPORTER_H
+#define INTEREST_RATE_MODELLING_PATH_EXPORTER_H
+
+#include "fwd_decl.h"
+#include "state.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class PathExporter
+     * Writes selected state variables at selected time points of many paths, one column per (variable, time)
+     * and one row per path, in path order.
+     * Paths are copied into a buffer of rows; full buffers are encoded and written by a background thread
+     * while the next one fills, so exporting only waits on the disk when it falls a whole buffer behind.
+     * Several threads may export paths, rows then following the order of the calls.
+     *
+     * Csv: a header line "path,<name>@<time>,...", then one line per path.
+     * BinaryColumns (native byte order): "IRMCOLS1", uint32 number of columns, uint32 0,
+     *   for each column a double time, a uint32 state variable index, a uint32 name length and the name,
+     *   then row groups of one buffer each: uint64 number of rows, then each column's values as doubles.
+     */
+    class PathExporter {
+    public:
+
+        enum class Format {
+            Csv,
+            BinaryColumns
+        };
+
+        /** Constructor
+         *
+         * @param fileName The file to create, or overwrite.
+         * @param format The encoding of the file.
+         * @param timeVector The time vector of the exported paths.
+         * @param timeIndices The time indices to export.
+         * @param variables The state variables to export.
+         * @param variableNames The names of the variables, for the column names.
+         * @param pathsPerBuffer The number of paths in a buffer, and in a row group.
+         */
+        PathExporter(
+                const std::string & fileName,
+                Format format,
+                ITimeVectorCPtr timeVector,
+                std::vector<int> timeIndices,
+                std::vector<StateVariable> variables,
+                const std::vector<std::string> & variableNames,
+                int pathsPerBuffer = 4096);
+        ~PathExporter();
+
+        PathExporter(const PathExporter &) = delete;
+        PathExporter & operator = (const PathExporter &) = delete;
+
+        /** Functions to export paths.
+         * Once the background writer failed, they rethrow its error without exporting.
+         */
+        void exportPath(const IPath & path);
+        void exportPaths(const PathBlock & paths);
+
+        /** Function to write the remaining paths and close the file.
+         * Rethrows the first error of the background writer.
+         */
+        void close();
+
+        int getNumColumns() const { return m_columns.size(); }
+        std::int64_t getNumPaths() const;
+
+    private:
+        struct Column {
+            int timeIndex;
+            StateVariable variable;
+            std::string name;
+        };
+
+        // values laid out as [column][row]
+        struct Buffer {
+            std::vector<double> values;
+            std::int64_t firstPath = 0;
+            int numRows = 0;
+        };
+
+        // the rows being filled go to the writer, once it is done with the previous ones
+        void handOver();
+        void runWriter();
+        void writeHeader(const ITimeVector & timeVector);
+        void writeBuffer(const Buffer & buffer);
+
+        std::ofstream m_file;
+        Format m_format;
+        int m_numTimes;
+        int m_stateSize;
+        std::vector<Column> m_columns;
+        int m_pathsPerBuffer;
+
+        mutable std::mutex m_fillMutex;  // serializes the exporting threads
+        Buffer m_filling;
+        std::exception_ptr m_failure;  // set once a hand over saw the writer fail
+
+        std::mutex m_mutex;  // guards the hand over to the writer
+        std::condition_variable m_condition;
+        Buffer m_writing;
+        bool m_isWriting = false;
+        bool m_isClosing = false;
+        std::exception_ptr m_error;
+        std::thread m_writer;
+    }; // end class PathExporter
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_PATH_EXPORTER_H
@@ -0,0 +1,127 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "path_statistics.h"
+
+#include "path.h"
+#include "path_block.h"
+#include "time.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace irm {
+
+    void RunningStatistics::add(const double * values, std::size_t n) {
+        if (n == 0)
+            return;
+        // two passes over the batch, then one merge, rather than n dependent updates
+        double sum = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            sum += values[i];
+        RunningStatistics batch;
+        batch.m_count = n;
+        batch.m_mean = sum / n;
+        for (std::size_t i = 0; i < n; ++i) {
+            double delta = values[i] - batch.m_mean;
+            batch.m_sumSquaredDeviations += delta * delta;
+        }
+        merge(batch);
+    }
+
+    void RunningStatistics::merge(const RunningStatistics & that) {
+        if (that.m_count == 0)
+            return;
+        if (m_count == 0) {
+            *this = that;
+            return;
+        }
+        std::int64_t count = m_count + that.m_count;
+        double delta = that.m_mean - m_mean;
+        double thatWeight = static_cast<double>(that.m_count) / count;
+        m_mean += delta * thatWeight;
+        m_sumSquaredDeviations += that.m_sumSquaredDeviations + delta * delta * m_count * thatWeight;
+        m_count = count;
+    }
+
+    double RunningStatistics::getStandardDeviation() const {
+        return std::sqrt(getVariance());
+    }
+
+    double RunningStatistics::getStandardError() const {
+        return m_count > 0 ? std::sqrt(getVariance() / m_count) : 0;
+    }
+
+    std::pair<double, double> RunningStatistics::getConfidenceInterval(double numStandardErrors) const {
+        double halfWidth = numStandardErrors * getStandardError();
+        return std::make_pair(m_mean - halfWidth, m_mean + halfWidth);
+    }
+
+
+    PathStatistics::PathStatistics(ITimeVectorCPtr timeVector, int stateSize):
+            m_timeVector(timeVector),
+            m_numTimes(timeVector ? timeVector->getNumTimes() : 0),
+            m_stateSize(stateSize),
+            m_numPaths(0),
+            m_statistics()
+    {
+        if (!m_timeVector)
+            throw std::invalid_argument("PathStatistics: null time vector");
+        if (stateSize < 1)
+            throw std::invalid_argument("PathStatistics: empty state");
+        m_statistics.resize(static_cast<size_t>(m_numTimes) * m_stateSize);
+    }
+
+    void PathStatistics::addPath(const IPath & path) {
+        checkShape(path.getNumTimes(), path.getStateSize());
+        for (int it = 0; it < m_numTimes; ++it) {
+            const IState & state = path.getStateAtIndex(it);
+            RunningStatistics * statistics = m_statistics.data() + static_cast<size_t>(it) * m_stateSize;
+            for (int iv = 0; iv < m_stateSize; ++iv)
+                statistics[iv].add(state.getValue(StateVariable(iv)));
+        }
+        ++m_numPaths;
+    }
+
+    void PathStatistics::addPaths(const PathBlock & paths) {
+        checkShape(paths.getNumTimes(), paths.getStateSize());
+        for (int it = 0; it < m_numTimes; ++it)
+            for (int iv = 0; iv < m_stateSize; ++iv)
+                m_statistics[static_cast<size_t>(it) * m_stateSize + iv].add(paths.getValues(it, StateVariable(iv)), paths.getNumPaths());
+        m_numPaths += paths.getNumPaths();
+    }
+
+    void PathStatistics::merge(const PathStatistics & that) {
+        checkShape(that.m_numTimes, that.m_stateSize);
+        for (size_t i = 0; i < m_statistics.size(); ++i)
+            m_statistics[i].merge(that.m_statistics[i]);
+        m_numPaths += that.m_numPaths;
+    }
+
+    void PathStatistics::checkShape(int numTimes, int stateSize) const {
+        if (numTimes != m_numTimes || stateSize != m_stateSize)
+            throw std::invalid_argument("PathStatistics: paths do not match the time vector or state size of the statistics");
+    }
+
+} // end namespace irm
@@ -0,0 +1,125 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_PATH_STATISTICS_H
+#define INTEREST_RATE_MODELLING_PATH_STATISTICS_H
+
+#include "fwd_decl.h"
+#include "state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class RunningStatistics
+     * Mean and variance of a stream of values, updated one value at a time (Welford)
+     * and merged with the statistics of another stream exactly (Chan et al.),
+     * so partial results computed on different threads combine into the statistics of all the values.
+     */
+    class RunningStatistics {
+    public:
+
+        RunningStatistics(): m_count(0), m_mean(0), m_sumSquaredDeviations(0) { }
+
+        void add(double value) {
+            ++m_count;
+            double delta = value - m_mean;
+            m_mean += delta / m_count;
+            m_sumSquaredDeviations += delta * (value - m_mean);
+        }
+
+        /** Function to add n values, accumulated as a batch and merged in. */
+        void add(const double * values, std::size_t n);
+
+        /** Function to merge in the statistics of another stream of values. */
+        void merge(const RunningStatistics & that);
+
+        std::int64_t getCount() const { return m_count; }
+        double getMean() const { return m_mean; }
+
+        /** The unbiased sample variance, 0 below two values. */
+        double getVariance() const { return m_count > 1 ? m_sumSquaredDeviations / (m_count - 1) : 0; }
+        double getStandardDeviation() const;
+
+        /** The standard error of the mean. */
+        double getStandardError() const;
+
+        /** The interval of numStandardErrors standard errors around the mean. */
+        std::pair<double, double> getConfidenceInterval(double numStandardErrors = 1.96) const;
+
+    private:
+        std::int64_t m_count;
+        double m_mean;
+        double m_sumSquaredDeviations;
+    }; // end class RunningStatistics
+
+
+    /**
+     * class PathStatistics
+     * RunningStatistics of every state variable at every time point of a time vector,
+     * fed with paths as they are generated, so memory does not grow with the number of paths.
+     */
+    class PathStatistics {
+    public:
+
+        PathStatistics(ITimeVectorCPtr timeVector, int stateSize);
+
+        /** Function to add a path on the time vector of the statistics. */
+        void addPath(const IPath & path);
+
+        /** Function to add all the paths of a block on the time vector of the statistics. */
+        void addPaths(const PathBlock & paths);
+
+        /** Function to merge in statistics over the same time vector and state size. */
+        void merge(const PathStatistics & that);
+
+        const RunningStatistics & getStatistics(int timeIndex, StateVariable x) const {
+            return m_statistics[static_cast<size_t>(timeIndex) * m_stateSize + x.index];
+        }
+
+        std::int64_t getNumPaths() const { return m_numPaths; }
+        int getNumTimes() const { return m_numTimes; }
+        int getStateSize() const { return m_stateSize; }
+        const ITimeVectorCPtr & getTimeVector() const { return m_timeVector; }
+
+    private:
+        void checkShape(int numTimes, int stateSize) const;
+
+        ITimeVectorCPtr m_timeVector;
+        int m_numTimes;
+        int m_stateSize;
+        std::int64_t m_numPaths;
+        std::vector<RunningStatistics> m_statistics;  // [time][state variable]
+    }; // end class PathStatistics
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_PATH_STATISTICS_H
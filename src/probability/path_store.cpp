@@ -0,0 +1,248 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "path_store.h"
+
+#include "path.h"
+#include "path_block.h"
+#include "time.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    const char Magic[8] = {'I', 'R', 'M', 'P', 'A', 'T', 'H', 'S'};
+    const std::uint32_t Version = 1;
+    const size_t ValuesAlignment = 64;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t stateSize;
+        std::uint32_t numTimes;
+        std::uint32_t reserved;
+        std::uint64_t seed;
+        std::uint64_t numPaths;
+        std::uint64_t valuesOffset;
+    };
+
+    template <typename T>
+    void writeRaw(std::ofstream & file, const T * data, size_t n) {
+        file.write(reinterpret_cast<const char *>(data), n * sizeof(T));
+    }
+
+    // reads a T at offset, advancing it; throws if the file is too short
+    template <typename T>
+    T readRaw(const char * data, size_t size, size_t & offset) {
+        if (offset + sizeof(T) > size)
+            throw std::runtime_error("PathStore: truncated header");
+        T value;
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    // whether count elements of elementSize bytes fit into available bytes, checked without overflowing
+    bool fits(std::uint64_t count, std::uint64_t elementSize, std::uint64_t available) {
+        return elementSize == 0 || count <= available / elementSize;
+    }
+
+} // end anonymous namespace
+
+namespace irm {
+
+    PathStoreWriter::PathStoreWriter(
+            const std::string & fileName,
+            ITimeVectorCPtr timeVector,
+            std::vector<std::string> variableNames,
+            std::uint64_t seed):
+            m_file(),
+            m_numTimes(timeVector ? timeVector->getNumTimes() : 0),
+            m_stateSize(variableNames.size()),
+            m_numPaths(0),
+            m_buffer(static_cast<size_t>(m_numTimes) * m_stateSize)
+    {
+        if (!timeVector || variableNames.empty())
+            throw std::invalid_argument("PathStoreWriter: null time vector or no state variable");
+        m_file.open(fileName, std::ios::binary | std::ios::trunc);
+        if (!m_file)
+            throw std::runtime_error("PathStoreWriter: cannot open " + fileName);
+
+        size_t namesSize = 0;
+        for (const std::string & name : variableNames)
+            namesSize += sizeof(std::uint32_t) + name.size();
+        size_t headerSize = sizeof(Header) + m_numTimes * sizeof(double) + namesSize;
+        Header header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.stateSize = m_stateSize;
+        header.numTimes = m_numTimes;
+        header.seed = seed;
+        header.valuesOffset = (headerSize + ValuesAlignment - 1) / ValuesAlignment * ValuesAlignment;
+        writeRaw(m_file, &header, 1);
+        for (int it = 0; it < m_numTimes; ++it) {
+            double t = timeVector->getTimeAtIndex(it);
+            writeRaw(m_file, &t, 1);
+        }
+        for (const std::string & name : variableNames) {
+            std::uint32_t length = name.size();
+            writeRaw(m_file, &length, 1);
+            writeRaw(m_file, name.data(), name.size());
+        }
+        std::vector<char> padding(header.valuesOffset - headerSize, 0);
+        writeRaw(m_file, padding.data(), padding.size());
+        checkStream();
+    }
+
+    PathStoreWriter::~PathStoreWriter() {
+        try {
+            close();
+        } catch (...) {
+            // destructors must not throw: call close() to see write errors
+        }
+    }
+
+    void PathStoreWriter::writePath(const IPath & path) {
+        if (path.getNumTimes() != m_numTimes || path.getStateSize() != m_stateSize)
+            throw std::invalid_argument("PathStoreWriter: path does not match the time vector or state size of the store");
+        for (int it = 0; it < m_numTimes; ++it) {
+            const IState & state = path.getStateAtIndex(it);
+            for (int iv = 0; iv < m_stateSize; ++iv)
+                m_buffer[static_cast<size_t>(it) * m_stateSize + iv] = state.getValue(StateVariable(iv));
+        }
+        writeRaw(m_file, m_buffer.data(), m_buffer.size());
+        checkStream();
+        ++m_numPaths;
+    }
+
+    void PathStoreWriter::writePaths(const PathBlock & paths) {
+        if (paths.getNumTimes() != m_numTimes || paths.getStateSize() != m_stateSize)
+            throw std::invalid_argument("PathStoreWriter: paths do not match the time vector or state size of the store");
+        for (int ip = 0; ip < paths.getNumPaths(); ++ip) {
+            for (int it = 0; it < m_numTimes; ++it)
+                for (int iv = 0; iv < m_stateSize; ++iv)
+                    m_buffer[static_cast<size_t>(it) * m_stateSize + iv] = paths.getValue(ip, it, StateVariable(iv));
+            writeRaw(m_file, m_buffer.data(), m_buffer.size());
+        }
+        checkStream();
+        m_numPaths += paths.getNumPaths();
+    }
+
+    void PathStoreWriter::close() {
+        if (!m_file.is_open())
+            return;
+        std::uint64_t numPaths = m_numPaths;
+        m_file.seekp(offsetof(Header, numPaths));
+        writeRaw(m_file, &numPaths, 1);
+        checkStream();
+        m_file.close();
+        checkStream();
+    }
+
+    void PathStoreWriter::checkStream() const {
+        if (!m_file.good())
+            throw std::runtime_error("PathStoreWriter: write failed");
+    }
+
+
+    PathStoreCPtr PathStore::open(const std::string & fileName) {
+        std::shared_ptr<PathStore> store(new PathStore());
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("PathStore: cannot open " + fileName);
+        struct stat status;
+        if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header))) {
+            ::close(fd);
+            throw std::runtime_error("PathStore: " + fileName + " is not a path store");
+        }
+        size_t size = status.st_size;
+        void * mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("PathStore: cannot map " + fileName);
+        store->m_mapping = mapping;
+        store->m_mappingSize = size;
+
+        const char * data = static_cast<const char *>(mapping);
+        size_t offset = 0;
+        Header header = readRaw<Header>(data, size, offset);
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version)
+            throw std::runtime_error("PathStore: " + fileName + " is not a path store of version " + std::to_string(Version));
+        // the header is not trusted: every size derived from it is checked against the file before use
+        const std::uint32_t maxInt = std::numeric_limits<int>::max();
+        if (header.numTimes > maxInt || header.stateSize > maxInt || !fits(header.numTimes, sizeof(double), size - offset))
+            throw std::runtime_error("PathStore: truncated header");
+        store->m_numTimes = header.numTimes;
+        store->m_stateSize = header.stateSize;
+        store->m_numPaths = header.numPaths;
+        store->m_seed = header.seed;
+        std::vector<Time> times(header.numTimes);
+        for (Time & t : times)
+            t = readRaw<double>(data, size, offset);
+        store->m_timeVector = ITimeVector::createFromVector(std::move(times));
+        for (std::uint32_t iv = 0; iv < header.stateSize; ++iv) {
+            std::uint32_t length = readRaw<std::uint32_t>(data, size, offset);
+            if (offset + length > size)
+                throw std::runtime_error("PathStore: truncated header");
+            store->m_variableNames.emplace_back(data + offset, length);
+            offset += length;
+        }
+        if (header.valuesOffset < offset || header.valuesOffset % sizeof(double) != 0 || header.valuesOffset > size)
+            throw std::runtime_error("PathStore: " + fileName + " is truncated");
+        std::uint64_t available = size - header.valuesOffset;
+        std::uint64_t stateBytes = static_cast<std::uint64_t>(header.stateSize) * sizeof(double);
+        // the first check bounds numTimes * stateBytes by available, so the second product cannot overflow
+        if (!fits(header.numTimes, stateBytes, available) || !fits(header.numPaths, header.numTimes * stateBytes, available))
+            throw std::runtime_error("PathStore: " + fileName + " is truncated");
+        store->m_values = reinterpret_cast<const double *>(data + header.valuesOffset);
+        return store;
+    }
+
+    PathStore::~PathStore() {
+        if (m_mapping)
+            ::munmap(m_mapping, m_mappingSize);
+    }
+
+    StateVariable PathStore::getStateVariable(const std::string & name) const {
+        for (size_t iv = 0; iv < m_variableNames.size(); ++iv)
+            if (m_variableNames[iv] == name)
+                return StateVariable(iv);
+        throw std::invalid_argument("PathStore: no state variable named " + name);
+    }
+
+    IPathCPtr PathStore::getPath(std::int64_t pathIndex) const {
+        if (pathIndex < 0 || pathIndex >= m_numPaths)
+            throw std::out_of_range("PathStore: path index out of range");
+        const double * data = m_values + static_cast<size_t>(pathIndex) * m_numTimes * m_stateSize;
+        return IPath::createView(m_timeVector, m_stateSize, data, m_stateSize, 1, shared_from_this());
+    }
+
+} // end namespace irm
@@ -0,0 +1,148 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_PATH_STORE_H
+#define INTEREST_RATE_MODELLING_PATH_STORE_H
+
+#include "fwd_decl.h"
+#include "state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * Binary path store format (native byte order):
+     *   "IRMPATHS", uint32 version, uint32 state size, uint32 number of times, uint32 0,
+     *   uint64 seed, uint64 number of paths, uint64 offset of the values,
+     *   the times as doubles, then for each state variable in index order a uint32 length and its name,
+     *   then, from the (64 byte aligned) offset of the values, the paths one after the other,
+     *   each path being row-major: numTimes x stateSize doubles.
+     */
+
+
+    /**
+     * class PathStoreWriter
+     * Streams paths to a path store file, one path or block of paths at a time.
+     * The number of paths in the header is written on close, which the destructor calls.
+     */
+    class PathStoreWriter {
+    public:
+
+        /** Constructor
+         *
+         * @param fileName The file to create, or overwrite.
+         * @param timeVector The time vector of all the paths.
+         * @param variableNames The name of every state variable, in index order.
+         * @param seed The seed the paths were generated with, recorded for the readers.
+         */
+        PathStoreWriter(
+                const std::string & fileName,
+                ITimeVectorCPtr timeVector,
+                std::vector<std::string> variableNames,
+                std::uint64_t seed);
+        ~PathStoreWriter();
+
+        PathStoreWriter(const PathStoreWriter &) = delete;
+        PathStoreWriter & operator = (const PathStoreWriter &) = delete;
+
+        void writePath(const IPath & path);
+        void writePaths(const PathBlock & paths);
+
+        /** Function to complete the header and close the file. Throws std::runtime_error if writing failed. */
+        void close();
+
+        std::int64_t getNumPaths() const { return m_numPaths; }
+
+    private:
+        void checkStream() const;
+
+        std::ofstream m_file;
+        int m_numTimes;
+        int m_stateSize;
+        std::int64_t m_numPaths;
+        std::vector<double> m_buffer;  // one path
+    }; // end class PathStoreWriter
+
+
+    /**
+     * class PathStore
+     * A path store file mapped into memory.
+     * Paths are views over the mapping, so opening a store costs no parsing or copying of the values,
+     * only page faults as the paths are read. The views keep the store mapped.
+     */
+    class PathStore : public std::enable_shared_from_this<PathStore> {
+    public:
+
+        /** Function to map the given file. Throws std::runtime_error if it is not a valid path store. */
+        static PathStoreCPtr open(const std::string & fileName);
+
+        ~PathStore();
+
+        PathStore(const PathStore &) = delete;
+        PathStore & operator = (const PathStore &) = delete;
+
+        std::int64_t getNumPaths() const { return m_numPaths; }
+        int getNumTimes() const { return m_numTimes; }
+        int getStateSize() const { return m_stateSize; }
+        std::uint64_t getSeed() const { return m_seed; }
+        const ITimeVectorCPtr & getTimeVector() const { return m_timeVector; }
+        const std::vector<std::string> & getVariableNames() const { return m_variableNames; }
+
+        /** The state variable of the given name. Throws std::invalid_argument if there is none. */
+        StateVariable getStateVariable(const std::string & name) const;
+
+        /** The row-major values of the path at pathIndex. */
+        const double * getValues(std::int64_t pathIndex) const {
+            return m_values + static_cast<size_t>(pathIndex) * m_numTimes * m_stateSize;
+        }
+
+        /** Path view into the mapping, without copying. */
+        IPathCPtr getPath(std::int64_t pathIndex) const;
+
+    private:
+        PathStore() = default;
+
+        void * m_mapping = nullptr;
+        size_t m_mappingSize = 0;
+        const double * m_values = nullptr;
+        std::int64_t m_numPaths = 0;
+        int m_numTimes = 0;
+        int m_stateSize = 0;
+        std::uint64_t m_seed = 0;
+        ITimeVectorCPtr m_timeVector;
+        std::vector<std::string> m_variableNames;
+    }; // end class PathStore
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_PATH_STORE_H
@@ -0,0 +1,71 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "philox.h"
+
+namespace irm {
+
+    PhiloxEngine::PhiloxEngine(std::uint64_t seed, std::uint64_t stream) :
+            m_key{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) },
+            m_stream(stream),
+            m_block(0),
+            m_buffer{ 0, 0 },
+            m_bufferIndex(2)
+    { }
+
+    void PhiloxEngine::seek(std::uint64_t offset) {
+        m_block = offset / 2;
+        m_bufferIndex = 2;
+        if (offset % 2 == 1) {
+            refill();
+            m_bufferIndex = 1;
+        }
+    }
+
+    void PhiloxEngine::seek(std::uint64_t stream, std::uint64_t offset) {
+        m_stream = stream;
+        seek(offset);
+    }
+
+    void PhiloxEngine::fill(result_type * out, std::size_t n) {
+        // drain what is left of the current block
+        std::size_t i = 0;
+        while (i < n && m_bufferIndex < 2)
+            out[i++] = m_buffer[m_bufferIndex++];
+
+        // whole blocks are independent of each other, and are written straight to the output
+        std::size_t numBlocks = (n - i) / 2;
+        std::uint64_t firstBlock = m_block;
+        result_type * blockOut = out + i;
+        for (std::size_t ib = 0; ib < numBlocks; ++ib)
+            generateOutputs(firstBlock + ib, blockOut + 2 * ib);
+        m_block += numBlocks;
+        i += 2 * numBlocks;
+
+        // the last odd output comes from a fresh block, leaving the rest of it for later
+        if (i < n)
+            out[i] = operator()();
+    }
+
+} // end namespace irm
@@ -0,0 +1,131 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_PHILOX_H
+#define INTEREST_RATE_MODELLING_PHILOX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace irm {
+
+
+    /**
+     * class PhiloxEngine
+     * Counter-based random number generator (Philox4x32-10, Salmon et al. 2011).
+     * Output number n of stream s under key k is a pure function of (k, s, n),
+     * so any position of any stream can be reached in O(1)
+     * and independent streams can be handed out to paths or threads without any seeding cost.
+     * Satisfies the UniformRandomBitGenerator concept and can be used with WienerProcess::generatePath.
+     */
+    class PhiloxEngine {
+    public:
+        typedef std::uint64_t result_type;
+        typedef std::array<std::uint32_t, 4> Counter;
+        typedef std::array<std::uint32_t, 2> Key;
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        /** Constructor
+         *
+         * @param seed The key of the generator.
+         * @param stream The index of the stream, streams being independent of each other.
+         */
+        explicit PhiloxEngine(std::uint64_t seed = 0, std::uint64_t stream = 0);
+
+        result_type operator()() {
+            if (m_bufferIndex == 2)
+                refill();
+            return m_buffer[m_bufferIndex++];
+        }
+
+        /** Jump to the given position (in 64 bit outputs) of the current stream. */
+        void seek(std::uint64_t offset);
+
+        /** Jump to the given position of the given stream. */
+        void seek(std::uint64_t stream, std::uint64_t offset);
+
+        /** Skip the next n outputs, in O(1). */
+        void discard(unsigned long long n) { seek(getOffset() + n); }
+
+        /** Fill out with the next n outputs, exactly as n calls to operator() would. */
+        void fill(result_type * out, std::size_t n);
+
+        std::uint64_t getStream() const { return m_stream; }
+        std::uint64_t getOffset() const { return 2 * m_block - (2 - m_bufferIndex); }
+
+        /** The Philox4x32-10 bijection, exposed for testing against reference vectors. */
+        static Counter generateBlock(Counter counter, Key key) {
+            for (int round = 0; round < 10; ++round) {
+                if (round > 0) {
+                    key[0] += 0x9E3779B9;
+                    key[1] += 0xBB67AE85;
+                }
+                std::uint64_t product0 = static_cast<std::uint64_t>(0xD2511F53) * counter[0];
+                std::uint64_t product1 = static_cast<std::uint64_t>(0xCD9E8D57) * counter[2];
+                counter = Counter{
+                    static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+                    static_cast<std::uint32_t>(product1),
+                    static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+                    static_cast<std::uint32_t>(product0) };
+            }
+            return counter;
+        }
+
+        bool operator == (const PhiloxEngine & that) const {
+            return m_key == that.m_key && m_stream == that.m_stream && getOffset() == that.getOffset();
+        }
+
+    private:
+
+        // two 64 bit outputs of block number b of the current stream
+        void generateOutputs(std::uint64_t block, result_type * out) const {
+            Counter c = generateBlock(
+                    Counter{ static_cast<std::uint32_t>(block), static_cast<std::uint32_t>(block >> 32),
+                             static_cast<std::uint32_t>(m_stream), static_cast<std::uint32_t>(m_stream >> 32) },
+                    m_key);
+            out[0] = (static_cast<std::uint64_t>(c[1]) << 32) | c[0];
+            out[1] = (static_cast<std::uint64_t>(c[3]) << 32) | c[2];
+        }
+
+        void refill() {
+            generateOutputs(m_block++, m_buffer.data());
+            m_bufferIndex = 0;
+        }
+
+        Key m_key;
+        std::uint64_t m_stream;
+        std::uint64_t m_block;              // next block to generate
+        std::array<result_type, 2> m_buffer;
+        int m_bufferIndex;                  // next unused output in m_buffer, 2 meaning empty
+    }; // end class PhiloxEngine
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_PHILOX_H
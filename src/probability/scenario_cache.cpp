@@ -0,0 +1,261 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "scenario_cache.h"
+
+#include "path_block.h"
+#include "path_store.h"
+#include "time.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#include <unistd.h>
+
+namespace {
+
+    const std::uint64_t FnvOffsetBasis = 14695981039346656037ull;
+    const std::uint64_t FnvPrime = 1099511628211ull;
+
+    void hashBytes(std::uint64_t & hash, const void * data, size_t size) {
+        const unsigned char * bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= FnvPrime;
+        }
+    }
+
+    template <typename T>
+    void hashValue(std::uint64_t & hash, T value) {
+        hashBytes(hash, &value, sizeof(value));
+    }
+
+    // strings are prefixed by their length, so that fields cannot run into each other
+    void hashString(std::uint64_t & hash, const std::string & value) {
+        hashValue<std::uint64_t>(hash, value.size());
+        hashBytes(hash, value.data(), value.size());
+    }
+
+    size_t getValuesBytes(const irm::PathStore & store) {
+        return static_cast<size_t>(store.getNumPaths()) * store.getNumTimes() * store.getStateSize() * sizeof(double);
+    }
+
+    // whether the keys are equal in every field, as equal hashes do not guarantee it
+    bool isSameKey(const irm::ScenarioCache::Key & a, const irm::ScenarioCache::Key & b) {
+        if (a.processDescription != b.processDescription || a.generatorType != b.generatorType
+                || a.seed != b.seed || a.pathBegin != b.pathBegin || a.numPaths != b.numPaths)
+            return false;
+        int numTimes = a.timeVector->getNumTimes();
+        if (b.timeVector->getNumTimes() != numTimes)
+            return false;
+        for (int it = 0; it < numTimes; ++it)
+            if (a.timeVector->getTimeAtIndex(it) != b.timeVector->getTimeAtIndex(it))
+                return false;
+        return true;
+    }
+
+} // end anonymous namespace
+
+namespace irm {
+
+    ScenarioCache::ScenarioCache(std::string directory, std::size_t maxMemoryBytes):
+            m_directory(std::move(directory)),
+            m_maxMemoryBytes(maxMemoryBytes),
+            m_memoryBytes(0),
+            m_entries(),
+            m_entryByHash(),
+            m_numMemoryHits(0),
+            m_numDiskHits(0),
+            m_numMisses(0)
+    {
+        std::filesystem::create_directories(m_directory);
+    }
+
+    std::uint64_t ScenarioCache::hash(const Key & key) {
+        if (!key.timeVector)
+            throw std::invalid_argument("ScenarioCache: null time vector");
+        std::uint64_t hash = FnvOffsetBasis;
+        hashString(hash, key.processDescription);
+        int numTimes = key.timeVector->getNumTimes();
+        hashValue<std::int64_t>(hash, numTimes);
+        for (int it = 0; it < numTimes; ++it)
+            hashValue<double>(hash, key.timeVector->getTimeAtIndex(it));
+        hashString(hash, key.generatorType);
+        hashValue(hash, key.seed);
+        hashValue(hash, key.pathBegin);
+        hashValue(hash, key.numPaths);
+        return hash;
+    }
+
+    std::string ScenarioCache::getFileName(const Key & key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.paths", static_cast<unsigned long long>(hash(key)));
+        return (std::filesystem::path(m_directory) / name).string();
+    }
+
+    std::int64_t ScenarioCache::getNumMemoryHits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numMemoryHits;
+    }
+
+    std::int64_t ScenarioCache::getNumDiskHits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numDiskHits;
+    }
+
+    std::int64_t ScenarioCache::getNumMisses() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numMisses;
+    }
+
+    std::size_t ScenarioCache::getMemoryBytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_memoryBytes;
+    }
+
+    PathStoreCPtr ScenarioCache::find(const Key & key) {
+        std::uint64_t keyHash = hash(key);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return findLocked(key, keyHash);
+    }
+
+    PathStoreCPtr ScenarioCache::getOrGenerate(
+            const Key & key,
+            const std::vector<std::string> & variableNames,
+            const Generator & generate)
+    {
+        std::uint64_t keyHash = hash(key);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            if (auto store = findLocked(key, keyHash))
+                return store;
+            if (m_generating.count(keyHash) == 0)
+                break;
+            // another thread generates the key, or one with the same hash: look again once it is done
+            m_generated.wait(lock);
+        }
+        ++m_numMisses;
+        m_generating.insert(keyHash);
+        lock.unlock();
+
+        PathStoreCPtr store;
+        try {
+            store = generateStore(key, variableNames, generate);
+        } catch (...) {
+            lock.lock();
+            m_generating.erase(keyHash);
+            lock.unlock();
+            m_generated.notify_all();
+            throw;
+        }
+        lock.lock();
+        m_generating.erase(keyHash);
+        remember(keyHash, key, store);
+        lock.unlock();
+        m_generated.notify_all();
+        return store;
+    }
+
+    PathStoreCPtr ScenarioCache::generateStore(
+            const Key & key,
+            const std::vector<std::string> & variableNames,
+            const Generator & generate) const
+    {
+        PathBlockCPtr paths = generate();
+        if (!paths || paths->getNumPaths() != key.numPaths || paths->getNumTimes() != key.timeVector->getNumTimes())
+            throw std::runtime_error("ScenarioCache: the generated paths do not match the key");
+
+        // written aside then renamed, so that readers never see a partial file;
+        // the temporary name is unique, as other processes may share the directory
+        std::string fileName = getFileName(key);
+        char suffix[48];
+        std::random_device random;
+        std::snprintf(suffix, sizeof(suffix), ".%ld.%08x%08x.tmp",
+                static_cast<long>(::getpid()), static_cast<unsigned>(random()), static_cast<unsigned>(random()));
+        std::string temporaryName = fileName + suffix;
+        try {
+            PathStoreWriter writer(temporaryName, key.timeVector, variableNames, key.seed);
+            writer.writePaths(*paths);
+            writer.close();
+            std::filesystem::rename(temporaryName, fileName);
+        } catch (...) {
+            std::error_code error;
+            std::filesystem::remove(temporaryName, error);
+            throw;
+        }
+        return PathStore::open(fileName);
+    }
+
+    PathStoreCPtr ScenarioCache::findLocked(const Key & key, std::uint64_t keyHash) {
+        auto entry = m_entryByHash.find(keyHash);
+        if (entry != m_entryByHash.end()) {
+            // a colliding key owns the hash, and its file too
+            if (!isSameKey(entry->second->key, key))
+                return nullptr;
+            m_entries.splice(m_entries.begin(), m_entries, entry->second);
+            ++m_numMemoryHits;
+            return entry->second->store;
+        }
+        std::string fileName = getFileName(key);
+        if (!std::filesystem::exists(fileName))
+            return nullptr;
+        auto store = PathStore::open(fileName);
+        // guard against hash collisions on what the store records
+        bool isMatch = store->getSeed() == key.seed
+                && store->getNumPaths() == key.numPaths
+                && store->getNumTimes() == key.timeVector->getNumTimes();
+        for (int it = 0; isMatch && it < store->getNumTimes(); ++it)
+            isMatch = store->getTimeVector()->getTimeAtIndex(it) == key.timeVector->getTimeAtIndex(it);
+        if (!isMatch)
+            return nullptr;
+        ++m_numDiskHits;
+        remember(keyHash, key, store);
+        return store;
+    }
+
+    void ScenarioCache::remember(std::uint64_t keyHash, const Key & key, PathStoreCPtr store) {
+        // a colliding key generated anew replaces the entry of the other one
+        auto entry = m_entryByHash.find(keyHash);
+        if (entry != m_entryByHash.end()) {
+            m_memoryBytes -= getValuesBytes(*entry->second->store);
+            m_entries.erase(entry->second);
+            m_entryByHash.erase(entry);
+        }
+        size_t bytes = getValuesBytes(*store);
+        if (bytes > m_maxMemoryBytes)
+            return;
+        m_entries.push_front(Entry{keyHash, key, std::move(store)});
+        m_entryByHash[keyHash] = m_entries.begin();
+        m_memoryBytes += bytes;
+        while (m_memoryBytes > m_maxMemoryBytes) {
+            m_memoryBytes -= getValuesBytes(*m_entries.back().store);
+            m_entryByHash.erase(m_entries.back().keyHash);
+            m_entries.pop_back();
+        }
+    }
+
+} // end namespace irm
@@ -0,0 +1,133 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_SCENARIO_CACHE_H
+#define INTEREST_RATE_MODELLING_SCENARIO_CACHE_H
+
+#include "fwd_decl.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class ScenarioCache
+     * Content addressed cache of generated paths.
+     * Entries are path store files in a directory, named by the hash of their key,
+     * and served by mapping them (see PathStore); the most recently used stores also stay mapped
+     * in an in-memory tier holding at most a given number of bytes of values.
+     * A WienerProcess holds arbitrary functions and cannot be hashed itself,
+     * so the key carries a description of the process from the caller, which must change with its definition.
+     */
+    class ScenarioCache {
+    public:
+
+        /** What the cached paths depend on. */
+        struct Key {
+            std::string processDescription;  // e.g. the model name and all of its parameters
+            ITimeVectorCPtr timeVector;
+            std::string generatorType;       // the random number generator, e.g. "Philox4x32-10"
+            std::uint64_t seed;
+            std::int64_t pathBegin;          // the paths [pathBegin, pathBegin + numPaths)
+            std::int64_t numPaths;
+        };
+
+        /** Generator: generates the paths of a key, on its time vector. */
+        typedef std::function< PathBlockCPtr() > Generator;
+
+        /** Constructor
+         *
+         * @param directory The directory of the cache files, created if needed.
+         * @param maxMemoryBytes The most bytes of values kept mapped by the in-memory tier.
+         */
+        ScenarioCache(std::string directory, std::size_t maxMemoryBytes);
+
+        /** Function to hash a key (FNV-1a over all of its fields). */
+        static std::uint64_t hash(const Key & key);
+
+        /** The cached paths of the key, or null if they are neither in memory nor on disk. */
+        PathStoreCPtr find(const Key & key);
+
+        /**
+         * Function to get the cached paths of the key, generating and storing them on a miss
+         * The cache is not locked while generating: a thread asking for a key being generated waits for it,
+         * other keys are served meanwhile.
+         * @param variableNames The names of the state variables, stored with generated paths.
+         * @param generate Called on a miss; must return key.numPaths paths on key.timeVector,
+         *                 and must not ask the cache for the same key.
+         */
+        PathStoreCPtr getOrGenerate(const Key & key, const std::vector<std::string> & variableNames, const Generator & generate);
+
+        /** The path of the cache file of the key. */
+        std::string getFileName(const Key & key) const;
+
+        std::int64_t getNumMemoryHits() const;
+        std::int64_t getNumDiskHits() const;
+        std::int64_t getNumMisses() const;
+        std::size_t getMemoryBytes() const;
+
+    private:
+        struct Entry {
+            std::uint64_t keyHash;
+            Key key;
+            PathStoreCPtr store;
+        };
+
+        typedef std::list<Entry> Entries;
+
+        // looks the key up in memory then on disk; the mutex must be held
+        PathStoreCPtr findLocked(const Key & key, std::uint64_t keyHash);
+        // generates the paths of the key and stores them to its file, without the mutex
+        PathStoreCPtr generateStore(const Key & key, const std::vector<std::string> & variableNames, const Generator & generate) const;
+        // makes store the most recently used entry, evicting the least recently used beyond the memory budget
+        void remember(std::uint64_t keyHash, const Key & key, PathStoreCPtr store);
+
+        std::string m_directory;
+        std::size_t m_maxMemoryBytes;
+        std::size_t m_memoryBytes;
+        Entries m_entries;  // most recently used first
+        std::unordered_map<std::uint64_t, Entries::iterator> m_entryByHash;
+        std::int64_t m_numMemoryHits;
+        std::int64_t m_numDiskHits;
+        std::int64_t m_numMisses;
+        std::unordered_set<std::uint64_t> m_generating;  // hashes of the keys being generated
+        std::condition_variable m_generated;
+        mutable std::mutex m_mutex;
+    }; // end class ScenarioCache
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_SCENARIO_CACHE_H
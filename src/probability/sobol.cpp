@@ -0,0 +1,228 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "sobol.h"
+#include "normal_sampler.h"
+
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace irm {
+
+    namespace {
+
+        // product of the polynomials a and b over GF(2), modulo the polynomial p of the given degree
+        // bit i of a polynomial is the coefficient of x^i
+        std::uint64_t multiplyModulo(std::uint64_t a, std::uint64_t b, std::uint64_t p, int degree) {
+            std::uint64_t result = 0;
+            for (; b != 0; b >>= 1) {
+                if (b & 1)
+                    result ^= a;
+                a <<= 1;
+                if (a >> degree & 1)
+                    a ^= p;
+            }
+            return result;
+        }
+
+        // x^n modulo p
+        std::uint64_t powerOfXModulo(std::uint64_t n, std::uint64_t p, int degree) {
+            std::uint64_t result = 1, square = degree > 1 ? 2 : 2 ^ p;
+            for (; n != 0; n >>= 1) {
+                if (n & 1)
+                    result = multiplyModulo(result, square, p, degree);
+                square = multiplyModulo(square, square, p, degree);
+            }
+            return result;
+        }
+
+        std::vector<std::uint64_t> primeFactors(std::uint64_t n) {
+            std::vector<std::uint64_t> factors;
+            for (std::uint64_t q = 2; q * q <= n; ++q) {
+                if (n % q == 0) {
+                    factors.push_back(q);
+                    while (n % q == 0)
+                        n /= q;
+                }
+            }
+            if (n > 1)
+                factors.push_back(n);
+            return factors;
+        }
+
+        // p is primitive iff x has order exactly 2^degree - 1 modulo p
+        bool isPrimitive(std::uint64_t p, int degree, const std::vector<std::uint64_t> & orderFactors) {
+            std::uint64_t order = (std::uint64_t(1) << degree) - 1;
+            if (powerOfXModulo(order, p, degree) != 1)
+                return false;
+            for (std::uint64_t q : orderFactors)
+                if (powerOfXModulo(order / q, p, degree) == 1)
+                    return false;
+            return true;
+        }
+
+        std::uint64_t splitMix64(std::uint64_t x) {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+    } // end anonymous namespace
+
+
+    SobolSequence::SobolSequence(int dimension) :
+            SobolSequence(dimension, createBuiltInInitialisations(dimension - 1))
+    { }
+
+    SobolSequence SobolSequence::createFromJoeKuo(int dimension, std::istream & directionNumbers) {
+        std::vector<Initialisation> initialisations;
+        std::string line;
+        std::getline(directionNumbers, line); // header
+        while (static_cast<int>(initialisations.size()) < dimension - 1 && std::getline(directionNumbers, line)) {
+            std::istringstream fields(line);
+            int d;
+            Initialisation init;
+            if (!(fields >> d >> init.degree >> init.coefficients))
+                break;
+            init.m.resize(init.degree);
+            for (auto & m : init.m)
+                fields >> m;
+            if (!fields || init.degree < 1 || init.degree > NumBits)
+                throw std::invalid_argument("SobolSequence: invalid direction numbers line: " + line);
+            initialisations.push_back(std::move(init));
+        }
+        if (dimension >= 1 && static_cast<int>(initialisations.size()) < dimension - 1)
+            throw std::invalid_argument("SobolSequence: not enough direction numbers for the requested dimension");
+        return SobolSequence(dimension, initialisations);
+    }
+
+    SobolSequence::SobolSequence(int dimension, const std::vector<Initialisation> & initialisations) :
+            m_dimension(dimension),
+            m_directions(static_cast<size_t>(NumBits) * std::max(dimension, 0), 0),
+            m_point(std::max(dimension, 0), 0),
+            m_index(0)
+    {
+        if (dimension < 1)
+            throw std::invalid_argument("SobolSequence: the dimension must be at least 1");
+
+        auto direction = [&](int bit, int j) -> std::uint32_t & { return m_directions[static_cast<size_t>(bit) * dimension + j]; };
+
+        // the first dimension is the van der Corput sequence
+        for (int bit = 0; bit < NumBits; ++bit)
+            direction(bit, 0) = std::uint32_t(1) << (NumBits - 1 - bit);
+
+        // the others follow the recurrence of their primitive polynomial
+        for (int j = 1; j < dimension; ++j) {
+            const Initialisation & init = initialisations[j - 1];
+            int s = init.degree;
+            for (int bit = 0; bit < NumBits; ++bit) {
+                if (bit < s) {
+                    direction(bit, j) = init.m[bit] << (NumBits - 1 - bit);
+                } else {
+                    std::uint32_t v = direction(bit - s, j) ^ (direction(bit - s, j) >> s);
+                    for (int i = 1; i < s; ++i)
+                        if (init.coefficients >> (s - 1 - i) & 1)
+                            v ^= direction(bit - i, j);
+                    direction(bit, j) = v;
+                }
+            }
+        }
+
+        skipTo(1);
+    }
+
+    std::vector<SobolSequence::Initialisation> SobolSequence::createBuiltInInitialisations(int numInitialisations) {
+        std::vector<Initialisation> initialisations;
+        for (int degree = 1; static_cast<int>(initialisations.size()) < numInitialisations; ++degree) {
+            if (degree > NumBits)
+                throw std::invalid_argument("SobolSequence: dimension too large for the built in direction numbers");
+            auto orderFactors = primeFactors((std::uint64_t(1) << degree) - 1);
+            std::uint64_t leading = std::uint64_t(1) << degree;
+            // candidates x^degree + ... + 1 in increasing order of their inner coefficients
+            for (std::uint64_t inner = 0; inner < (leading >> 1) && static_cast<int>(initialisations.size()) < numInitialisations; ++inner) {
+                std::uint64_t p = leading | (inner << 1) | 1;
+                if (!isPrimitive(p, degree, orderFactors))
+                    continue;
+                Initialisation init{ degree, static_cast<std::uint32_t>(inner), {} };
+                // odd m_k < 2^k, derived from the dimension and k only
+                for (int k = 1; k <= degree; ++k) {
+                    std::uint64_t bits = splitMix64((initialisations.size() + 1) * 64 + k);
+                    init.m.push_back(static_cast<std::uint32_t>((bits % (std::uint64_t(1) << (k - 1))) * 2 + 1));
+                }
+                initialisations.push_back(std::move(init));
+            }
+        }
+        return initialisations;
+    }
+
+    void SobolSequence::skipTo(std::uint64_t index) {
+        if (index == 0 || index >> NumBits != 0)
+            throw std::out_of_range("SobolSequence: index out of the sequence");
+        std::uint64_t gray = index ^ (index >> 1);
+        std::fill(m_point.begin(), m_point.end(), 0);
+        for (int bit = 0; bit < NumBits; ++bit) {
+            if (gray >> bit & 1) {
+                const std::uint32_t * v = m_directions.data() + static_cast<size_t>(bit) * m_dimension;
+                for (int j = 0; j < m_dimension; ++j)
+                    m_point[j] ^= v[j];
+            }
+        }
+        m_index = index;
+    }
+
+    void SobolSequence::nextUniforms(double * out) {
+        if (m_index >> NumBits != 0)
+            throw std::out_of_range("SobolSequence: the sequence is exhausted");
+        const double scale = 1.0 / 4294967296.0;
+        for (int j = 0; j < m_dimension; ++j)
+            out[j] = m_point[j] * scale;
+
+        // consecutive Gray codes differ by the lowest zero bit of the index
+        int bit = 0;
+        while (m_index >> bit & 1)
+            ++bit;
+        if (bit < NumBits) {
+            const std::uint32_t * v = m_directions.data() + static_cast<size_t>(bit) * m_dimension;
+            for (int j = 0; j < m_dimension; ++j)
+                m_point[j] ^= v[j];
+        }
+        ++m_index;
+    }
+
+    void SobolSequence::nextNormals(double * out) {
+        nextUniforms(out);
+        NormalSampler::uniformsToNormals(out, m_dimension);
+    }
+
+    void SobolSequence::fillNormals(double * out, std::size_t numPoints) {
+        for (std::size_t i = 0; i < numPoints; ++i)
+            nextNormals(out + i * m_dimension);
+    }
+
+} // end namespace irm
@@ -0,0 +1,111 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_SOBOL_H
+#define INTEREST_RATE_MODELLING_SOBOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class SobolSequence
+     * Low discrepancy (quasi random) sequence of points in the unit hypercube, generated in Gray code order.
+     * Used to generate paths, each path consumes one point, of dimension WienerProcess::getRequiredNumberOfSamples(),
+     *   mapped to standard normals by inversion.
+     * The first point of the sequence (the origin) is skipped, so that every coordinate is in the open interval (0, 1).
+     *
+     * The direction numbers are either built in, or read from a file in the format of Joe & Kuo (2008),
+     *   eg. new-joe-kuo-6.21201, which supports up to 21201 dimensions.
+     * The built in direction numbers use the primitive polynomials in increasing order, like Joe & Kuo,
+     *   but with deterministic pseudo random initial direction numbers instead of optimised ones,
+     *   so high dimensional projections are of lower quality than with the Joe & Kuo file.
+     */
+    class SobolSequence {
+    public:
+
+        /** The number of bits of each coordinate, which also bounds the length of the sequence to 2^NumBits - 1. */
+        static constexpr int NumBits = 32;
+
+        /** Constructor, with built in direction numbers
+         *
+         * @param dimension The number of coordinates of each point, at least 1.
+         */
+        explicit SobolSequence(int dimension);
+
+        /** Create a sequence with direction numbers read from a file in the Joe & Kuo format:
+         * a header line, followed by one line "d s a m_1 ... m_s" per dimension d, starting at d = 2.
+         * Throws std::invalid_argument if the file has less than dimension - 1 valid lines.
+         */
+        static SobolSequence createFromJoeKuo(int dimension, std::istream & directionNumbers);
+
+        int getDimension() const { return m_dimension; }
+
+        /** The index of the next point in the sequence, starting at 1. */
+        std::uint64_t getIndex() const { return m_index; }
+
+        /** Jump to the point at the given index, in O(dimension * NumBits).
+         * Lets paths [begin, end) be generated independently of the paths before them.
+         */
+        void skipTo(std::uint64_t index);
+
+        /** Write the next point, of getDimension() coordinates in (0, 1), to out. */
+        void nextUniforms(double * out);
+
+        /** Write the inverse cumulative normals of the next point to out. */
+        void nextNormals(double * out);
+
+        /** Write the normals of the next numPoints points to out, point i starting at out[i * getDimension()]. */
+        void fillNormals(double * out, std::size_t numPoints);
+
+    private:
+
+        // helper struct
+        // the primitive polynomial and initial direction numbers of one dimension, as in Joe & Kuo
+        struct Initialisation {
+            int degree;
+            std::uint32_t coefficients;       // a
+            std::vector<std::uint32_t> m;     // m_1 ... m_degree
+        };
+
+        SobolSequence(int dimension, const std::vector<Initialisation> & initialisations);
+        static std::vector<Initialisation> createBuiltInInitialisations(int numInitialisations);
+
+
+        // member variables
+        int m_dimension;
+        std::vector<std::uint32_t> m_directions;  // [bit][dimension]
+        std::vector<std::uint32_t> m_point;       // the integer coordinates of the next point
+        std::uint64_t m_index;
+    }; // end class SobolSequence
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_SOBOL_H
@@ -53,6 +53,43 @@ namespace irm {
         static IStatePtr createFromVector(std::vector<double> value);
     };
 
+
+    /** StateView
+     * Non-owning view of a state whose values live in someone else's buffer.
+     * Consecutive values of the state are stride doubles apart,
+     * which lets the same type view row-major paths, column-major paths and path blocks.
+     * The class is final, so calls made through a StateView (rather than an IState)
+     * are resolved statically and can be inlined.
+     */
+    class StateView final : public IState {
+    public:
+        StateView(double * data, int numValues, int stride) :
+                m_data(data),
+                m_numValues(numValues),
+                m_stride(stride)
+        { }
+
+        int getNumValues() const override {
+            return m_numValues;
+        }
+
+        double getValue(StateVariable x) const override {
+            return m_data[x.index * m_stride];
+        }
+
+        void setValue(StateVariable x, double value) override {
+            m_data[x.index * m_stride] = value;
+        }
+
+        const double * getData() const { return m_data; }
+        int getStride() const { return m_stride; }
+
+    private:
+        double * m_data;
+        int m_numValues;
+        int m_stride;
+    }; // end class StateView
+
 } // end namespace irm
 
 
@@ -0,0 +1,219 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_STATIC_PROCESS_H
+#define INTEREST_RATE_MODELLING_STATIC_PROCESS_H
+
+#include "fwd_decl.h"
+#include "normal_sampler.h"
+#include "path.h"
+#include "path_block.h"
+#include "state.h"
+#include "time.h"
+#include "time_grid.h"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace irm {
+
+
+    /** Definition of a derived state variable, keeping the concrete type of its function. */
+    template<typename Function>
+    struct DerivedVariableDefn {
+        Function function;
+        double initialValue;
+    };
+
+    /** Definition of an Ito process, keeping the concrete types of its drift and volatility. */
+    template<typename Drift, typename Volatility>
+    struct ItoProcessDefn {
+        Drift drift;
+        Volatility volatility;
+        double initialValue;
+    };
+
+    template<typename Function>
+    DerivedVariableDefn<Function> derivedVariable(Function variableDefinition, double initialValue) {
+        return { std::move(variableDefinition), initialValue };
+    }
+
+    template<typename Drift, typename Volatility>
+    ItoProcessDefn<Drift, Volatility> itoIntegralProcess(Drift drift, Volatility volatility, double initialValue) {
+        return { std::move(drift), std::move(volatility), initialValue };
+    }
+
+
+    /**
+     * class StaticProcess
+     * Compile-time counterpart of WienerProcess, for models that are fixed at compile time.
+     * The definitions keep the concrete types of their functions (typically lambdas),
+     * so the whole step is a single inlinable function without any std::function call.
+     * The i-th definition (counting from 0) is the state variable StateVariable(i + 1),
+     * StateVariable(0) being the wiener process itself.
+     * The functions are called as f(Time, const StateView &) and follow the same rules as in WienerProcess.
+     * Paths generated from the same random numbers are identical to those
+     *   of a WienerProcess with the same definitions added in the same order.
+     */
+    template<typename... Defns>
+    class StaticProcess {
+    public:
+
+        static constexpr int StateSize = 1 + sizeof...(Defns);
+
+        /** Constructor
+         *
+         * @param timeVector The time points in the generated state space, frozen as in WienerProcess.
+         * @param initialValue The initial value of the wiener process.
+         * @param defns The definitions of the derived variables and Ito processes, in order.
+         */
+        StaticProcess(ITimeVectorCPtr timeVector, double initialValue, Defns... defns) :
+                m_timeGrid(ITimeGrid::freeze(timeVector)),
+                m_initialValue{ initialValue, defns.initialValue... },
+                m_defns(std::move(defns)...)
+        { }
+
+        template<typename RandomNumberGenerator>
+        IPathCPtr generatePath(RandomNumberGenerator & rng) const {
+            std::vector<double> brownianSample(getRequiredNumberOfSamples());
+            NormalSampler::fill(rng, brownianSample.data(), brownianSample.size());
+            return generatePathFromSamples(brownianSample);
+        }
+
+        template<typename RandomNumberGenerator>
+        PathBlockCPtr generatePaths(RandomNumberGenerator & rng, int numPaths) const {
+            int numBrownianSamples = getRequiredNumberOfSamples();
+            std::vector<double> brownianSamples(static_cast<size_t>(numBrownianSamples) * numPaths);
+            for (int ip = 0; ip < numPaths; ++ip)
+                NormalSampler::fillStrided(rng, brownianSamples.data() + ip, numBrownianSamples, numPaths);
+            return generatePathBlock(brownianSamples, numPaths);
+        }
+
+        int getRequiredNumberOfSamples() const {
+            return m_timeGrid->getNumTimes() - 1;
+        }
+
+    private:
+
+        IPathCPtr generatePathFromSamples(const std::vector<double> & brownianSample) const {
+            int numTimes = m_timeGrid->getNumTimes();
+            std::vector<double> values(static_cast<size_t>(numTimes) * StateSize, 0.0);
+            if (numTimes > 0)
+                std::copy(m_initialValue.begin(), m_initialValue.end(), values.begin());
+
+            visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+                for (int it = 1; it < numTimes; ++it) {
+                    const StateView prevState(values.data() + static_cast<size_t>(it - 1) * StateSize, StateSize, 1);
+                    StateView curState(values.data() + static_cast<size_t>(it) * StateSize, StateSize, 1);
+                    double dW = brownianSample[it - 1] * timeGrid.getSqrtDtAtIndex(it);
+                    curState.setValue(StateVariable(0), prevState.getValue(StateVariable(0)) + dW);
+                    advanceAll(timeGrid.getTimeAtIndex(it), timeGrid.getDtAtIndex(it), dW, prevState, curState,
+                               std::index_sequence_for<Defns...>());
+                }
+            });
+            return IPath::createFromValues(m_timeGrid, StateSize, std::move(values));
+        }
+
+        // brownianSamples are laid out as [sample][path]
+        PathBlockCPtr generatePathBlock(const std::vector<double> & brownianSamples, int numPaths) const {
+            auto block = std::make_shared<PathBlock>(m_timeGrid, numPaths, StateSize);
+            for (int i = 0; i < StateSize; ++i) {
+                double * x0 = block->getValues(0, StateVariable(i));
+                std::fill(x0, x0 + numPaths, m_initialValue[i]);
+            }
+
+            int numTimes = m_timeGrid->getNumTimes();
+            std::vector<double> dW(numPaths);
+            visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+                for (int it = 1; it < numTimes; ++it) {
+                    Time t = timeGrid.getTimeAtIndex(it);
+                    Time dt = timeGrid.getDtAtIndex(it);
+                    double sqrtDt = timeGrid.getSqrtDtAtIndex(it);
+                    const double * z = brownianSamples.data() + static_cast<size_t>(it - 1) * numPaths;
+                    const double * wPrev = block->getValues(it - 1, StateVariable(0));
+                    double * wCur = block->getValues(it, StateVariable(0));
+                    for (int ip = 0; ip < numPaths; ++ip) {
+                        dW[ip] = z[ip] * sqrtDt;
+                        wCur[ip] = wPrev[ip] + dW[ip];
+                    }
+                    for (int ip = 0; ip < numPaths; ++ip) {
+                        const StateView prevState = block->getState(ip, it - 1);
+                        StateView curState = block->getState(ip, it);
+                        advanceAll(t, dt, dW[ip], prevState, curState, std::index_sequence_for<Defns...>());
+                    }
+                }
+            });
+            return block;
+        }
+
+        template<size_t... I>
+        void advanceAll(Time t, Time dt, double dW, const StateView & prevState, StateView & curState, std::index_sequence<I...>) const {
+            (advance(std::get<I>(m_defns), StateVariable(I + 1), t, dt, dW, prevState, curState), ...);
+        }
+
+        template<typename Function>
+        static void advance(
+                const DerivedVariableDefn<Function> & defn,
+                StateVariable x,
+                Time t,
+                Time,
+                double,
+                const StateView &,
+                StateView & curState)
+        {
+            curState.setValue(x, defn.function(t, curState));
+        }
+
+        template<typename Drift, typename Volatility>
+        static void advance(
+                const ItoProcessDefn<Drift, Volatility> & defn,
+                StateVariable x,
+                Time t,
+                Time dt,
+                double dW,
+                const StateView & prevState,
+                StateView & curState)
+        {
+            double prevValue = prevState.getValue(x);
+            curState.setValue(x, prevValue + dt * defn.drift(t, prevState) + dW * defn.volatility(t, prevState));
+        }
+
+        ITimeGridCPtr m_timeGrid;
+        std::vector<double> m_initialValue;
+        std::tuple<Defns...> m_defns;
+    }; // end class StaticProcess
+
+
+    template<typename... Defns>
+    StaticProcess<Defns...> makeStaticProcess(ITimeVectorCPtr timeVector, double initialValue, Defns... defns) {
+        return StaticProcess<Defns...>(std::move(timeVector), initialValue, std::move(defns)...);
+    }
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_STATIC_PROCESS_H
@@ -25,6 +25,10 @@ SOFTWARE.
 
 #include "time.h"
 
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
 namespace {
 
     using namespace irm;
@@ -70,5 +74,21 @@ namespace irm {
         return std::make_shared<TimeVectorFromVector>(std::move(tv));
     }
 
+    std::vector<int> findTimeIndices(const ITimeVector & timeVector, const std::vector<Time> & times, Time tolerance)
+    {
+        std::vector<int> indices;
+        indices.reserve(times.size());
+        int numTimes = timeVector.getNumTimes();
+        int it = 0;
+        for (Time t : times) {
+            while (it < numTimes && timeVector.getTimeAtIndex(it) < t - tolerance)
+                ++it;
+            if (it == numTimes || std::abs(timeVector.getTimeAtIndex(it) - t) > tolerance)
+                throw std::invalid_argument("findTimeIndices: time " + std::to_string(t) + " is not on the time vector");
+            indices.push_back(it);
+        }
+        return indices;
+    }
+
 
 } // end namespace irm
\ No newline at end of file
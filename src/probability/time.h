@@ -42,6 +42,11 @@ namespace irm {
         static ITimeVectorPtr createUniform(Time start, Time dt, int numTimes);
     };
 
+    /** Function to find the index of each of the given sorted times in the time vector.
+     * Throws std::invalid_argument if a time is not on the time vector (up to the tolerance).
+     */
+    std::vector<int> findTimeIndices(const ITimeVector & timeVector, const std::vector<Time> & times, Time tolerance = 1e-12);
+
 } // end namespace irm
 
 
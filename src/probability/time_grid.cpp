@@ -0,0 +1,79 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "time_grid.h"
+
+#include <stdexcept>
+
+namespace irm {
+
+    void ITimeGrid::setTimeAtIndex(int, Time) {
+        throw std::logic_error("ITimeGrid: a time grid cannot be modified");
+    }
+
+    ITimeGridCPtr ITimeGrid::freeze(const ITimeVectorCPtr & timeVector) {
+        if (auto timeGrid = std::dynamic_pointer_cast<const ITimeGrid>(timeVector))
+            return timeGrid;
+
+        int numTimes = timeVector->getNumTimes();
+        std::vector<Time> t;
+        t.reserve(numTimes);
+        for (int it = 0; it < numTimes; ++it)
+            t.push_back(timeVector->getTimeAtIndex(it));
+
+        // only switch to the uniform representation if it reproduces every time point exactly
+        if (numTimes >= 2) {
+            UniformTimeGrid uniform(t[0], t[1] - t[0], numTimes);
+            bool isUniform = true;
+            for (int it = 0; it < numTimes && isUniform; ++it)
+                isUniform = (uniform.getTimeAtIndex(it) == t[it]);
+            if (isUniform)
+                return std::make_shared<UniformTimeGrid>(uniform);
+        }
+        return createFromVector(std::move(t));
+    }
+
+    ITimeGridCPtr ITimeGrid::createFromVector(std::vector<Time> t) {
+        return std::make_shared<NonUniformTimeGrid>(std::move(t));
+    }
+
+    ITimeGridCPtr ITimeGrid::createUniform(Time start, Time dt, int numTimes) {
+        return std::make_shared<UniformTimeGrid>(start, dt, numTimes);
+    }
+
+
+    NonUniformTimeGrid::NonUniformTimeGrid(std::vector<Time> timePoints) :
+            m_timePoints(std::move(timePoints)),
+            m_dt(m_timePoints.size(), 0.0),
+            m_sqrtDt(m_timePoints.size(), 0.0)
+    {
+        for (size_t it = 1; it < m_timePoints.size(); ++it) {
+            m_dt[it] = m_timePoints[it] - m_timePoints[it - 1];
+            if (m_dt[it] < 0)
+                throw std::invalid_argument("NonUniformTimeGrid: time points must be increasing");
+            m_sqrtDt[it] = std::sqrt(m_dt[it]);
+        }
+    }
+
+} // end namespace irm
@@ -0,0 +1,123 @@
+/*
+
+Copyright 2020 Parakram Majumdar
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef INTEREST_RATE_MODELLING_TIME_GRID_H
+#define INTEREST_RATE_MODELLING_TIME_GRID_H
+
+#include "fwd_decl.h"
+#include "time.h"
+
+#include <cmath>
+#include <vector>
+
+namespace irm {
+
+
+    /**
+     * class ITimeGrid
+     * A time vector frozen at construction, which also knows the step sizes dt and their square roots.
+     * Anything built on top of a time grid (eg. a WienerProcess) can rely on it never changing,
+     * setTimeAtIndex throwing a std::logic_error.
+     * dt and sqrt(dt) at index i are those of the step from time i - 1 to time i, for i >= 1.
+     * The two implementations are final, so code that knows which one it holds
+     * gets every accessor inlined.
+     */
+    class ITimeGrid : public ITimeVector {
+    public:
+        virtual Time getDtAtIndex(int ti) const = 0;
+        virtual double getSqrtDtAtIndex(int ti) const = 0;
+        virtual bool isUniform() const = 0;
+
+        void setTimeAtIndex(int ti, Time t) override;
+
+        /** Function to freeze a copy of the time vector into a time grid.
+         * Time vectors that already are time grids are returned as is,
+         * time vectors on an exactly uniform grid become a UniformTimeGrid.
+         */
+        static ITimeGridCPtr freeze(const ITimeVectorCPtr & timeVector);
+        static ITimeGridCPtr createFromVector(std::vector<Time> t);
+        static ITimeGridCPtr createUniform(Time start, Time dt, int numTimes);
+    }; // end class ITimeGrid
+
+
+    /** Time grid start + i * dt for i in [0, numTimes), storing no array at all. */
+    class UniformTimeGrid final : public ITimeGrid {
+    public:
+        UniformTimeGrid(Time start, Time dt, int numTimes) :
+                m_start(start),
+                m_dt(dt),
+                m_sqrtDt(std::sqrt(dt)),
+                m_numTimes(numTimes)
+        { }
+
+        int getNumTimes() const override { return m_numTimes; }
+        Time getTimeAtIndex(int ti) const override { return m_start + m_dt * ti; }
+        Time getDtAtIndex(int) const override { return m_dt; }
+        double getSqrtDtAtIndex(int) const override { return m_sqrtDt; }
+        bool isUniform() const override { return true; }
+
+    private:
+        Time m_start;
+        Time m_dt;
+        double m_sqrtDt;
+        int m_numTimes;
+    }; // end class UniformTimeGrid
+
+
+    /** Time grid on arbitrary increasing time points, with dt and sqrt(dt) precomputed. */
+    class NonUniformTimeGrid final : public ITimeGrid {
+    public:
+        explicit NonUniformTimeGrid(std::vector<Time> timePoints);
+
+        int getNumTimes() const override { return m_timePoints.size(); }
+        Time getTimeAtIndex(int ti) const override { return m_timePoints[ti]; }
+        Time getDtAtIndex(int ti) const override { return m_dt[ti]; }
+        double getSqrtDtAtIndex(int ti) const override { return m_sqrtDt[ti]; }
+        bool isUniform() const override { return false; }
+
+    private:
+        std::vector<Time> m_timePoints;
+        std::vector<Time> m_dt;
+        std::vector<double> m_sqrtDt;
+    }; // end class NonUniformTimeGrid
+
+
+    /** Function to call function(grid) with the grid cast to its concrete type,
+     * so that a loop over the grid written as a generic lambda is compiled once per grid type
+     * with all accessors resolved statically.
+     */
+    template<typename Function>
+    decltype(auto) visitTimeGrid(const ITimeGrid & timeGrid, Function && function) {
+        if (auto uniform = dynamic_cast<const UniformTimeGrid *>(&timeGrid))
+            return function(*uniform);
+        if (auto nonUniform = dynamic_cast<const NonUniformTimeGrid *>(&timeGrid))
+            return function(*nonUniform);
+        return function(timeGrid);
+    }
+
+
+} // end namespace irm
+
+
+#endif //INTEREST_RATE_MODELLING_TIME_GRID_H
@@ -25,9 +25,88 @@ SOFTWARE.
 
 #include "wiener_process.h"
 
+#include "brownian_bridge.h"
 #include "state.h"
 #include "time.h"
+#include "time_grid.h"
 #include "path.h"
+#include "path_block.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+
+namespace {
+
+    // least number of (variable, path) evaluations in a level for evaluating it on several threads
+    const long ParallelEvaluationThreshold = 1 << 14;
+
+    // lower triangular L, row-major, with L L' = correlation
+    // semi-definite matrices are accepted, a zero pivot zeroing the rest of its column
+    std::vector<double> choleskyFactor(const std::vector<std::vector<double>> & correlation) {
+        const double tolerance = 1e-12;
+        size_t n = correlation.size();
+        for (size_t i = 0; i < n; ++i) {
+            if (correlation[i].size() != n || std::abs(correlation[i][i] - 1) > tolerance)
+                throw std::invalid_argument("WienerProcess: a correlation matrix must be square, with a unit diagonal");
+            for (size_t j = 0; j < i; ++j)
+                if (std::abs(correlation[i][j] - correlation[j][i]) > tolerance)
+                    throw std::invalid_argument("WienerProcess: a correlation matrix must be symmetric");
+        }
+
+        std::vector<double> l(n * n, 0.0);
+        for (size_t j = 0; j < n; ++j) {
+            double pivot = correlation[j][j];
+            for (size_t k = 0; k < j; ++k)
+                pivot -= l[j * n + k] * l[j * n + k];
+            if (pivot < -tolerance)
+                throw std::invalid_argument("WienerProcess: a correlation matrix must be positive semi-definite");
+            double ljj = pivot > tolerance ? std::sqrt(pivot) : 0.0;
+            l[j * n + j] = ljj;
+            for (size_t i = j + 1; i < n; ++i) {
+                double x = correlation[i][j];
+                for (size_t k = 0; k < j; ++k)
+                    x -= l[i * n + k] * l[j * n + k];
+                if (ljj > 0)
+                    l[i * n + j] = x / ljj;
+                else if (std::abs(x) > tolerance)
+                    throw std::invalid_argument("WienerProcess: a correlation matrix must be positive semi-definite");
+            }
+        }
+        return l;
+    }
+
+    // Euler step of log X, given the drift and volatility of X
+    inline double logEulerStep(double prev, double drift, double volatility, double dt, double dW) {
+        double logVolatility = volatility / prev;
+        return prev * std::exp((drift / prev - .5 * logVolatility * logVolatility) * dt + logVolatility * dW);
+    }
+
+    // central finite difference of f with respect to x
+    irm::WienerProcess::StateFunction createNumericalDerivative(irm::WienerProcess::StateFunction f, irm::StateVariable x) {
+        return [f = std::move(f), x](irm::Time t, const irm::StateView & state) {
+            thread_local std::vector<double> bumpedValues;
+            int numValues = state.getNumValues();
+            bumpedValues.resize(numValues);
+            for (int i = 0; i < numValues; ++i)
+                bumpedValues[i] = state.getValue(irm::StateVariable(i));
+            irm::StateView bumped(bumpedValues.data(), numValues, 1);
+            double x0 = bumpedValues[x.index];
+            double h = 1e-6 * std::max(1.0, std::abs(x0));
+            bumped.setValue(x, x0 + h);
+            double up = f(t, bumped);
+            bumped.setValue(x, x0 - h);
+            double down = f(t, bumped);
+            return (up - down) / (2 * h);
+        };
+    }
+
+} // end anonymous namespace
+
 
 namespace irm {
 
@@ -36,23 +115,70 @@ namespace irm {
     WienerProcess::WienerProcess(
             ITimeVectorCPtr timeVector,
             double initialValue):
-            m_timeVector(timeVector),
+            m_timeGrid(ITimeGrid::freeze(timeVector)),
+            m_numFactors(1),
+            m_cholesky(1, 1.0),
             m_initialValue(1, initialValue),
-            m_stateVariableDefns()
+            m_stepOps(),
+            m_outputs(),
+            m_stepPlan(),
+            m_levelEnds(),
+            m_isComputed(1, true),
+            m_numEvaluationThreads(1),
+            m_brownianBridge()
     { }
 
+    WienerProcess::WienerProcess(
+            ITimeVectorCPtr timeVector,
+            std::vector<double> initialValues,
+            const std::vector<std::vector<double>> & correlation):
+            m_timeGrid(ITimeGrid::freeze(timeVector)),
+            m_numFactors(initialValues.size()),
+            m_cholesky(choleskyFactor(correlation)),
+            m_initialValue(std::move(initialValues)),
+            m_stepOps(),
+            m_outputs(),
+            m_stepPlan(),
+            m_levelEnds(),
+            m_isComputed(m_numFactors, true),
+            m_numEvaluationThreads(1),
+            m_brownianBridge()
+    {
+        if (m_numFactors < 1 || correlation.size() != static_cast<size_t>(m_numFactors))
+            throw std::invalid_argument("WienerProcess: one initial value and one correlation row per factor are required");
+    }
+
+
+
+    WienerProcessPtr WienerProcess::createOnTimeVector(ITimeVectorCPtr timeVector) const {
+        auto process = std::make_shared<WienerProcess>(*this);
+        process->m_timeGrid = ITimeGrid::freeze(timeVector);
+        // recompute everything that was computed for the time grid
+        for (StepOp & op : process->m_stepOps)
+            if (op.kind == StepKind::ExactGeometricBrownian || op.kind == StepKind::ExactOrnsteinUhlenbeck)
+                process->computeStepCoefficients(op);
+        process->setPathConstruction(getPathConstruction());
+        return process;
+    }
+
 
 
     StateVariable WienerProcess::addDerivedStateVariable(
             StateFunction variableDefinition,
             double initialValue)
     {
-        StateVariable nextIndex(m_initialValue.size());
-        m_initialValue.push_back(initialValue);
-        auto svd = std::make_shared<StateVariableDefn>();
-        svd->currentStateFunction = variableDefinition;
-        m_stateVariableDefns.push_back(svd);
-        return nextIndex;
+        return addStepOp(StepOp{ .kind = StepKind::Derived, .function = std::move(variableDefinition) }, initialValue);
+    }
+
+    StateVariable WienerProcess::addDerivedStateVariable(
+            StateFunction variableDefinition,
+            double initialValue,
+            std::vector<StateVariable> dependencies)
+    {
+        for (StateVariable d : dependencies)
+            if (d.index < 0 || d.index >= static_cast<int>(m_initialValue.size()))
+                throw std::invalid_argument("WienerProcess: a derived variable can only depend on previously defined variables");
+        return addStepOp(StepOp{ .kind = StepKind::Derived, .function = std::move(variableDefinition), .hasDeclaredDependencies = true, .dependencies = std::move(dependencies) }, initialValue);
     }
 
     StateVariable WienerProcess::addItoIntegralProcess(
@@ -60,81 +186,839 @@ namespace irm {
             StateFunction volatility,
             double initialValue)
     {
+        StepKind kind =
+                drift && volatility ? StepKind::Ito
+                : drift ? StepKind::DriftOnly
+                : volatility ? StepKind::VolatilityOnly
+                : StepKind::Constant;
+        return addStepOp(StepOp{ .kind = kind, .function = std::move(drift), .volatility = std::move(volatility) }, initialValue);
+    }
+
+    StateVariable WienerProcess::addItoIntegralProcess(
+            StateFunction drift,
+            StateFunction volatility,
+            double initialValue,
+            std::vector<StateVariable> dependencies)
+    {
+        for (StateVariable d : dependencies)
+            if (d.index < 0 || d.index > static_cast<int>(m_initialValue.size()))
+                throw std::invalid_argument("WienerProcess: an Ito process can only depend on previously defined variables or itself");
+        StateVariable x = addItoIntegralProcess(std::move(drift), std::move(volatility), initialValue);
+        m_stepOps.back().hasDeclaredDependencies = true;
+        m_stepOps.back().dependencies = std::move(dependencies);
+        compilePlan();
+        return x;
+    }
+
+    StateVariable WienerProcess::addItoIntegralProcess(
+            StateFunction drift,
+            std::vector<FactorLoading> loadings,
+            double initialValue)
+    {
+        loadings.erase(
+                std::remove_if(loadings.begin(), loadings.end(), [](const FactorLoading & l) { return !l.volatility; }),
+                loadings.end());
+        for (const FactorLoading & l : loadings)
+            if (l.factor < 0 || l.factor >= m_numFactors)
+                throw std::invalid_argument("WienerProcess: unknown factor");
+
+        // a single loading is stepped like any single factor Ito process
+        if (loadings.size() <= 1) {
+            int factor = loadings.empty() ? 0 : loadings.front().factor;
+            StateVariable x = addItoIntegralProcess(std::move(drift), loadings.empty() ? StateFunction() : std::move(loadings.front().volatility), initialValue);
+            m_stepOps.back().factor = factor;
+            return x;
+        }
+        if (!drift)
+            drift = [](Time, const StateView &) { return 0.0; };
+        return addStepOp(StepOp{ .kind = StepKind::MultiFactor, .function = std::move(drift), .loadings = std::move(loadings) }, initialValue);
+    }
+
+    StateVariable WienerProcess::addItoIntegralProcess(
+            StateFunction drift,
+            std::vector<FactorLoading> loadings,
+            double initialValue,
+            std::vector<StateVariable> dependencies)
+    {
+        for (StateVariable d : dependencies)
+            if (d.index < 0 || d.index > static_cast<int>(m_initialValue.size()))
+                throw std::invalid_argument("WienerProcess: an Ito process can only depend on previously defined variables or itself");
+        StateVariable x = addItoIntegralProcess(std::move(drift), std::move(loadings), initialValue);
+        m_stepOps.back().hasDeclaredDependencies = true;
+        m_stepOps.back().dependencies = std::move(dependencies);
+        compilePlan();
+        return x;
+    }
+
+    void WienerProcess::setItoScheme(StateVariable x, ItoScheme scheme, StateFunction volatilityDerivative) {
+        if (x.index < m_numFactors || x.index >= static_cast<int>(m_initialValue.size()))
+            throw std::invalid_argument("WienerProcess: unknown Ito process");
+        StepOp & op = m_stepOps[x.index - m_numFactors];
+        bool isSingleFactorIto =
+                op.kind == StepKind::Ito || op.kind == StepKind::VolatilityOnly
+                || op.kind == StepKind::Milstein || op.kind == StepKind::LogEuler;
+        if (!isSingleFactorIto)
+            throw std::invalid_argument("WienerProcess: only single factor Ito processes with a volatility have a choice of scheme");
+        if (!op.function)
+            op.function = [](Time, const StateView &) { return 0.0; };
+
+        switch (scheme) {
+            case ItoScheme::Euler:
+                op.kind = StepKind::Ito;
+                break;
+            case ItoScheme::Milstein:
+                op.kind = StepKind::Milstein;
+                op.volatilityDerivative = volatilityDerivative ? std::move(volatilityDerivative) : createNumericalDerivative(op.volatility, x);
+                // the batch functions only cover the Euler and log-Euler steps
+                op.batchFunction = BatchFunction();
+                op.batchVolatility = BatchFunction();
+                break;
+            case ItoScheme::LogEuler:
+                op.kind = StepKind::LogEuler;
+                break;
+        }
+    }
+
+    StateVariable WienerProcess::addGeometricBrownianMotion(double drift, double volatility, double initialValue, int factor) {
+        return addExactProcess(StepKind::ExactGeometricBrownian, {drift, volatility, 0.0}, initialValue, factor);
+    }
+
+    StateVariable WienerProcess::addOrnsteinUhlenbeckProcess(
+            double meanReversion,
+            double longTermMean,
+            double volatility,
+            double initialValue,
+            int factor)
+    {
+        return addExactProcess(StepKind::ExactOrnsteinUhlenbeck, {meanReversion, longTermMean, volatility}, initialValue, factor);
+    }
+
+    StateVariable WienerProcess::addExactProcess(
+            StepKind kind,
+            std::array<double, 3> parameters,
+            double initialValue,
+            int factor)
+    {
+        if (factor < 0 || factor >= m_numFactors)
+            throw std::invalid_argument("WienerProcess: unknown factor");
+        StepOp op{ .kind = kind, .hasDeclaredDependencies = true, .factor = factor, .exactParameters = parameters };
+        computeStepCoefficients(op);
+        return addStepOp(std::move(op), initialValue);
+    }
+
+    void WienerProcess::computeStepCoefficients(StepOp & op) const {
+        int numTimes = m_timeGrid->getNumTimes();
+        op.stepCoefficients.assign(2 * static_cast<size_t>(numTimes), 0.0);
+        for (int it = 1; it < numTimes; ++it) {
+            auto c = computeExactCoefficients(op, m_timeGrid->getDtAtIndex(it), m_timeGrid->getSqrtDtAtIndex(it));
+            op.stepCoefficients[2 * it] = c.first;
+            op.stepCoefficients[2 * it + 1] = c.second;
+        }
+    }
+
+    std::pair<double, double> WienerProcess::computeExactCoefficients(const StepOp & op, Time dt, double sqrtDt) {
+        if (op.kind == StepKind::ExactGeometricBrownian) {
+            double drift = op.exactParameters[0], volatility = op.exactParameters[1];
+            return { (drift - .5 * volatility * volatility) * dt, volatility };
+        }
+
+        double meanReversion = op.exactParameters[0], volatility = op.exactParameters[2];
+        double decay = std::exp(-meanReversion * dt);
+        // variance of the transition, sigma^2 (1 - e^{-2 k dt}) / 2k, tending to sigma^2 dt as k goes to 0
+        double variance = std::abs(meanReversion * dt) > 1e-8
+                ? volatility * volatility * -std::expm1(-2 * meanReversion * dt) / (2 * meanReversion)
+                : volatility * volatility * dt;
+        // the normal of the transition is the normal of the step, dW / sqrt(dt)
+        return { decay, sqrtDt > 0 ? std::sqrt(variance) / sqrtDt : 0.0 };
+    }
+
+    StateVariable WienerProcess::addStepOp(StepOp op, double initialValue) {
         StateVariable nextIndex(m_initialValue.size());
         m_initialValue.push_back(initialValue);
-        auto svd = std::make_shared<StateVariableDefn>();
-        svd->drift = drift;
-        svd->volatility = volatility;
-        m_stateVariableDefns.push_back(svd);
+        op.variable = nextIndex;
+        m_stepOps.push_back(std::move(op));
+        compilePlan();
         return nextIndex;
     }
 
+    void WienerProcess::setOutputVariables(std::vector<StateVariable> outputs) {
+        for (StateVariable x : outputs)
+            if (x.index < 0 || x.index >= static_cast<int>(m_initialValue.size()))
+                throw std::invalid_argument("WienerProcess: unknown output variable");
+        m_outputs = std::move(outputs);
+        compilePlan();
+    }
+
+    bool WienerProcess::isComputed(StateVariable x) const {
+        return m_isComputed.at(x.index);
+    }
+
+    void WienerProcess::setNumEvaluationThreads(int numThreads) {
+        m_numEvaluationThreads = std::max(numThreads, 1);
+    }
+
+    void WienerProcess::setPathConstruction(PathConstruction construction) {
+        if (construction == PathConstruction::BrownianBridge)
+            m_brownianBridge = std::make_shared<BrownianBridge>(*m_timeGrid);
+        else
+            m_brownianBridge.reset();
+    }
+
+    WienerProcess::PathConstruction WienerProcess::getPathConstruction() const {
+        return m_brownianBridge ? PathConstruction::BrownianBridge : PathConstruction::Incremental;
+    }
+
+    void WienerProcess::constructBrownianSamples(double * brownianSamples, int numPaths) const {
+        if (!m_brownianBridge)
+            return;
+        // each factor is bridged on its own, before correlation
+        int numSteps = m_brownianBridge->getNumSteps();
+        std::vector<double> normals(numSteps), increments(numSteps);
+        for (int ip = 0; ip < numPaths; ++ip) {
+            for (int f = 0; f < m_numFactors; ++f) {
+                auto sample = [&](int is) -> double & {
+                    return brownianSamples[(static_cast<size_t>(is) * m_numFactors + f) * numPaths + ip];
+                };
+                for (int is = 0; is < numSteps; ++is)
+                    normals[is] = sample(is);
+                m_brownianBridge->buildIncrements(normals.data(), increments.data());
+                for (int is = 0; is < numSteps; ++is)
+                    sample(is) = increments[is];
+            }
+        }
+    }
+
+    void WienerProcess::compilePlan() {
+        int stateSize = m_initialValue.size();
+
+        // mark everything the outputs depend on, transitively
+        // the factors are always computed
+        std::vector<bool> isComputed(stateSize, m_outputs.empty());
+        std::fill(isComputed.begin(), isComputed.begin() + m_numFactors, true);
+        std::vector<int> toVisit;
+        for (StateVariable x : m_outputs)
+            if (!isComputed[x.index]) {
+                isComputed[x.index] = true;
+                toVisit.push_back(x.index);
+            }
+        while (!toVisit.empty()) {
+            int v = toVisit.back();
+            toVisit.pop_back();
+            if (v < m_numFactors)
+                continue;
+            const StepOp & op = m_stepOps[v - m_numFactors];
+            auto markComputed = [&](int d) {
+                if (!isComputed[d]) {
+                    isComputed[d] = true;
+                    toVisit.push_back(d);
+                }
+            };
+            if (op.hasDeclaredDependencies)
+                for (StateVariable d : op.dependencies)
+                    markComputed(d.index);
+            else
+                for (int d = 0; d < stateSize; ++d)
+                    markComputed(d);
+        }
+
+        // Ito processes only read the previous state, so they are all on level 0
+        // a derived variable goes one level above the derived variables it reads
+        // (the factors being computed before level 0)
+        std::vector<int> level(stateSize, -1);
+        int maxLevel = -1;
+        for (const StepOp & op : m_stepOps) {
+            int v = op.variable.index;
+            if (op.kind == StepKind::Derived) {
+                int maxDependencyLevel = -1;
+                if (op.hasDeclaredDependencies)
+                    for (StateVariable d : op.dependencies)
+                        maxDependencyLevel = std::max(maxDependencyLevel, level[d.index]);
+                else
+                    for (int d = 0; d < v; ++d)
+                        maxDependencyLevel = std::max(maxDependencyLevel, level[d]);
+                level[v] = maxDependencyLevel + 1;
+            } else {
+                level[v] = 0;
+            }
+            if (isComputed[v])
+                maxLevel = std::max(maxLevel, level[v]);
+        }
+
+        m_stepPlan.clear();
+        m_levelEnds.clear();
+        for (int l = 0; l <= maxLevel; ++l) {
+            for (int iop = 0; iop < static_cast<int>(m_stepOps.size()); ++iop)
+                if (isComputed[iop + m_numFactors] && level[iop + m_numFactors] == l)
+                    m_stepPlan.push_back(iop);
+            m_levelEnds.push_back(m_stepPlan.size());
+        }
+        m_isComputed = std::move(isComputed);
+    }
+
+
+    ITimeVectorCPtr WienerProcess::getObservationTimeVector(const std::vector<int> & observationIndices) const {
+        int numTimes = m_timeGrid->getNumTimes();
+        std::vector<Time> observationTimes;
+        observationTimes.reserve(observationIndices.size());
+        for (size_t i = 0; i < observationIndices.size(); ++i) {
+            int it = observationIndices[i];
+            if (it < 0 || it >= numTimes || (i > 0 && it <= observationIndices[i - 1]))
+                throw std::invalid_argument("WienerProcess: observation indices must be strictly increasing indices of the time vector");
+            observationTimes.push_back(m_timeGrid->getTimeAtIndex(it));
+        }
+        return ITimeVector::createFromVector(std::move(observationTimes));
+    }
 
     int WienerProcess::getRequiredNumberOfSamples() const {
-        return m_timeVector->getNumTimes() - 1;
+        return (m_timeGrid->getNumTimes() - 1) * m_numFactors;
     }
 
-    IPathCPtr WienerProcess::generatePath(std::vector<double> brownianSample) const {
-        // generate empty path
-        auto path = IPath::createZeroPath(m_timeVector, m_initialValue.size());
+    void WienerProcess::correlateIncrements(const double * z, double scale, double * dW, int numPaths) const {
+        // dW_f = scale * sum_{g <= f} L_fg z_g, one factor across all paths at a time
+        for (int f = 0; f < m_numFactors; ++f) {
+            const double * l = m_cholesky.data() + static_cast<size_t>(f) * m_numFactors;
+            double * dWf = dW + static_cast<size_t>(f) * numPaths;
+            std::fill(dWf, dWf + numPaths, 0.0);
+            for (int g = 0; g <= f; ++g) {
+                if (l[g] == 0)
+                    continue;
+                const double * zg = z + static_cast<size_t>(g) * numPaths;
+                for (int ip = 0; ip < numPaths; ++ip)
+                    dWf[ip] += l[g] * zg[ip];
+            }
+            for (int ip = 0; ip < numPaths; ++ip)
+                dWf[ip] *= scale;
+        }
+    }
+
+    void WienerProcess::advanceState(
+            int it,
+            Time t,
+            Time dt,
+            const double * dW,
+            const StateView & prevState,
+            StateView & curState) const
+    {
+        // get the next wiener values
+        for (int f = 0; f < m_numFactors; ++f)
+            curState.setValue(StateVariable(f), prevState.getValue(StateVariable(f)) + dW[f]);
+
+        // compute all the derived variables
+        for (int iop : m_stepPlan)
+            advanceVariable(m_stepOps[iop], it, t, dt, dW, 1, prevState, curState);
+    }
+
+    void WienerProcess::advanceVariableBatch(
+            const StepOp & op,
+            Time t,
+            Time dt,
+            const double * dW,
+            const double * prevValues,
+            double * curValues,
+            std::size_t stride,
+            int numPaths)
+    {
+        size_t offset = op.variable.index * stride;
+        const double * prev = prevValues + offset;
+        double * cur = curValues + offset;
+        if (op.kind == StepKind::Derived) {
+            op.batchFunction(t, curValues, stride, numPaths, cur);
+            return;
+        }
+
+        // same arithmetic as advanceVariable, one array at a time
+        thread_local std::vector<double> drift, volatility;
+        drift.resize(numPaths);
+        volatility.resize(numPaths);
+        op.batchFunction(t, prevValues, stride, numPaths, drift.data());
+        op.batchVolatility(t, prevValues, stride, numPaths, volatility.data());
+        if (op.kind == StepKind::LogEuler) {
+            for (int ip = 0; ip < numPaths; ++ip)
+                cur[ip] = logEulerStep(prev[ip], drift[ip], volatility[ip], dt, dW[ip]);
+        } else {
+            for (int ip = 0; ip < numPaths; ++ip)
+                cur[ip] = prev[ip] + dt * drift[ip] + dW[ip] * volatility[ip];
+        }
+    }
+
+    void WienerProcess::advanceVariable(
+            const StepOp & op,
+            int it,
+            Time t,
+            Time dt,
+            const double * dW,
+            std::size_t dWStride,
+            const StateView & prevState,
+            StateView & curState)
+    {
+        StateVariable x = op.variable;
+        switch (op.kind) {
+            // variable is a function of the current state
+            case StepKind::Derived:
+                curState.setValue(x, op.function(t, curState));
+                break;
+
+            // variable is an ito process
+            // incrementing on the previous state value
+            // based on the drift and volatility
+            case StepKind::Ito:
+                curState.setValue(x, prevState.getValue(x) + dt * op.function(t, prevState) + dW[op.factor * dWStride] * op.volatility(t, prevState));
+                break;
+            case StepKind::DriftOnly:
+                curState.setValue(x, prevState.getValue(x) + dt * op.function(t, prevState));
+                break;
+            case StepKind::VolatilityOnly:
+                curState.setValue(x, prevState.getValue(x) + dW[op.factor * dWStride] * op.volatility(t, prevState));
+                break;
+            case StepKind::Constant:
+                curState.setValue(x, prevState.getValue(x));
+                break;
+            case StepKind::MultiFactor: {
+                double value = prevState.getValue(x) + dt * op.function(t, prevState);
+                for (const FactorLoading & l : op.loadings)
+                    value += dW[l.factor * dWStride] * l.volatility(t, prevState);
+                curState.setValue(x, value);
+                break;
+            }
+
+            // higher order and exact schemes
+            case StepKind::Milstein: {
+                double dWf = dW[op.factor * dWStride];
+                double volatility = op.volatility(t, prevState);
+                curState.setValue(x, prevState.getValue(x) + dt * op.function(t, prevState) + dWf * volatility
+                                     + .5 * volatility * op.volatilityDerivative(t, prevState) * (dWf * dWf - dt));
+                break;
+            }
+            case StepKind::LogEuler:
+                curState.setValue(x, logEulerStep(prevState.getValue(x), op.function(t, prevState), op.volatility(t, prevState), dt, dW[op.factor * dWStride]));
+                break;
+            case StepKind::ExactGeometricBrownian:
+            case StepKind::ExactOrnsteinUhlenbeck: {
+                // steps off the time grid (see generateAdaptivePath) compute their coefficients on the fly
+                auto c = it >= 0
+                        ? std::make_pair(op.stepCoefficients[2 * it], op.stepCoefficients[2 * it + 1])
+                        : computeExactCoefficients(op, dt, std::sqrt(dt));
+                double prev = prevState.getValue(x);
+                double dWf = dW[op.factor * dWStride];
+                if (op.kind == StepKind::ExactGeometricBrownian) {
+                    curState.setValue(x, prev * std::exp(c.first + c.second * dWf));
+                } else {
+                    double longTermMean = op.exactParameters[1];
+                    curState.setValue(x, longTermMean + (prev - longTermMean) * c.first + c.second * dWf);
+                }
+                break;
+            }
+        }
+    }
+
+    IPathCPtr WienerProcess::generatePathFromNormals(const std::vector<double> & brownianSample) const {
+        if (static_cast<int>(brownianSample.size()) != getRequiredNumberOfSamples())
+            throw std::invalid_argument("WienerProcess: one normal per time step and factor is required to generate a path");
+        const double * brownianSamples = brownianSample.data();
+        std::vector<double> bridgedSamples;
+        if (m_brownianBridge) {
+            bridgedSamples = brownianSample;
+            constructBrownianSamples(bridgedSamples.data(), 1);
+            brownianSamples = bridgedSamples.data();
+        }
+
+        // generate the row-major values of the path directly,
+        // so that the loop below never goes through the virtual IPath interface
+        int stateSize = m_initialValue.size();
+        int numTimes = m_timeGrid->getNumTimes();
+        std::vector<double> values(static_cast<size_t>(numTimes) * stateSize, 0.0);
 
         // set initial state
+        // variables that are not computed keep their initial value all along the path
+        bool isComputingAll = std::find(m_isComputed.begin(), m_isComputed.end(), false) == m_isComputed.end();
+        for (int it = 0; it < (isComputingAll ? std::min(numTimes, 1) : numTimes); ++it)
+            std::copy(m_initialValue.begin(), m_initialValue.end(), values.begin() + static_cast<size_t>(it) * stateSize);
+
+
+        // loop over time incrementally to generate the rest of the path
+        std::vector<double> dW(m_numFactors);
+        visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+            for (int it = 1; it < numTimes; ++it)
+            {
+                // advance the state
+                const StateView prevState(values.data() + static_cast<size_t>(it - 1) * stateSize, stateSize, 1);
+                StateView curState(values.data() + static_cast<size_t>(it) * stateSize, stateSize, 1);
+
+                // get the next wiener values
+                const double * z = brownianSamples + static_cast<size_t>(it - 1) * m_numFactors;
+                correlateIncrements(z, getSampleScale(timeGrid.getSqrtDtAtIndex(it)), dW.data(), 1);
+                advanceState(it, timeGrid.getTimeAtIndex(it), timeGrid.getDtAtIndex(it), dW.data(), prevState, curState);
+            }
+        });
+
+        return IPath::createFromValues(m_timeGrid, stateSize, std::move(values));
+    }
+
+    IPathCPtr WienerProcess::generateAdaptivePathFromNormals(
+            std::vector<double> brownianSamples,
+            const std::function<void(double *, std::size_t)> & drawNormals,
+            double tolerance,
+            int maxDepth,
+            int * numSteps) const
+    {
+        if (maxDepth < 0)
+            throw std::invalid_argument("WienerProcess: the depth of adaptive refinement cannot be negative");
+        constructBrownianSamples(brownianSamples.data(), 1);
+
         int stateSize = m_initialValue.size();
+        int numTimes = m_timeGrid->getNumTimes();
+        std::vector<double> values(static_cast<size_t>(numTimes) * stateSize, 0.0);
+        for (int it = 0; it < numTimes; ++it)
+            std::copy(m_initialValue.begin(), m_initialValue.end(), values.begin() + static_cast<size_t>(it) * stateSize);
+
+        // scratch space for each depth of refinement, allocated once for the path
+        int totalSteps = 0;
+        std::vector<double> dW(m_numFactors);
+        std::vector<double> scratch(static_cast<size_t>(maxDepth) * (4 * m_numFactors + 2 * stateSize));
+        for (int it = 1; it < numTimes; ++it) {
+            const StateView prevState(values.data() + static_cast<size_t>(it - 1) * stateSize, stateSize, 1);
+            StateView curState(values.data() + static_cast<size_t>(it) * stateSize, stateSize, 1);
+            const double * z = brownianSamples.data() + static_cast<size_t>(it - 1) * m_numFactors;
+            correlateIncrements(z, getSampleScale(m_timeGrid->getSqrtDtAtIndex(it)), dW.data(), 1);
+            totalSteps += advanceAdaptively(
+                    it, m_timeGrid->getTimeAtIndex(it), m_timeGrid->getDtAtIndex(it), dW.data(),
+                    prevState, curState, false, scratch.data(), drawNormals, tolerance, maxDepth);
+        }
+        if (numSteps)
+            *numSteps = totalSteps;
+        return IPath::createFromValues(m_timeGrid, stateSize, std::move(values));
+    }
+
+    int WienerProcess::advanceAdaptively(
+            int it,
+            Time t,
+            Time dt,
+            const double * dW,
+            const StateView & prevState,
+            StateView & curState,
+            bool isStepped,
+            double * scratch,
+            const std::function<void(double *, std::size_t)> & drawNormals,
+            double tolerance,
+            int depth) const
+    {
+        int numSteps = 0;
+        if (!isStepped) {
+            advanceState(it, t, dt, dW, prevState, curState);
+            ++numSteps;
+        }
+        if (depth == 0 || dt <= 0)
+            return numSteps;
+
+        // the scratch of this depth, the deeper ones following it
+        int stateSize = m_initialValue.size();
+        double * z = scratch;
+        double * deviation = z + m_numFactors;
+        double * dW1 = deviation + m_numFactors;
+        double * dW2 = dW1 + m_numFactors;
+        double * midValues = dW2 + m_numFactors;
+        double * halfValues = midValues + stateSize;
+        double * deeperScratch = halfValues + stateSize;
+
+        // the same step in two halves, the midpoint of the wiener processes being drawn from the brownian bridge
+        drawNormals(z, m_numFactors);
+        correlateIncrements(z, .5 * std::sqrt(dt), deviation, 1);
+        for (int f = 0; f < m_numFactors; ++f) {
+            dW1[f] = .5 * dW[f] + deviation[f];
+            dW2[f] = .5 * dW[f] - deviation[f];
+        }
         for (int i = 0; i < stateSize; ++i)
-            path->getStateAtIndex(0).setValue(StateVariable(i), m_initialValue[i]);
+            midValues[i] = halfValues[i] = prevState.getValue(StateVariable(i));
+        StateView midState(midValues, stateSize, 1), halfState(halfValues, stateSize, 1);
+        advanceState(-1, t - .5 * dt, .5 * dt, dW1, prevState, midState);
+        advanceState(-1, t, .5 * dt, dW2, midState, halfState);
+        numSteps += 2;
 
+        double error = 0;
+        for (int iop : m_stepPlan) {
+            StateVariable x = m_stepOps[iop].variable;
+            double half = halfState.getValue(x);
+            error = std::max(error, std::abs(curState.getValue(x) - half) / (1 + std::abs(half)));
+        }
+        for (int i = 0; i < stateSize; ++i)
+            curState.setValue(StateVariable(i), halfValues[i]);
+        if (error <= tolerance)
+            return numSteps;
 
-        // loop over time incrementally to generate the rest of the path
-        int numTimes = m_timeVector->getNumTimes();
-        Time t = (numTimes > 0 ? m_timeVector->getTimeAtIndex(0) : 0);
-        Time tprev = t;
-        StateVariable xW(0);
-        for (int it = 1; it < numTimes; ++it)
-        {
-            // advance the state
-            const IState & prevState = path->getStateAtIndex(it - 1);
-            IState & curState = path->getStateAtIndex(it);
-
-            // get the next wiener value
-            tprev = t;
-            t = m_timeVector->getTimeAtIndex(it);
-            Time dt = t - tprev;
-            int ibrownian = it - 1;
-            double dW = brownianSample[ibrownian] *  std::sqrt(dt);
-            curState.setValue(xW, prevState.getValue(xW) + dW);
-
-            // compute all the derived variables
-            int nsvd = m_stateVariableDefns.size();
-            for (int isvd = 0; isvd < nsvd; ++isvd)
+        // refine both halves along the same brownian path, starting from the half steps just taken;
+        // once the first half moved the midpoint, the single step of the second half is taken again from it,
+        // so that its error estimate is only its own
+        int firstHalfSteps = advanceAdaptively(
+                -1, t - .5 * dt, .5 * dt, dW1, prevState, midState, true, deeperScratch, drawNormals, tolerance, depth - 1);
+        numSteps += firstHalfSteps;
+        numSteps += advanceAdaptively(
+                -1, t, .5 * dt, dW2, midState, curState, firstHalfSteps == 0, deeperScratch, drawNormals, tolerance, depth - 1);
+        return numSteps;
+    }
+
+    PathBlockCPtr WienerProcess::generatePathsFromNormals(const std::vector<double> & normals, int numPaths) const {
+        int numBrownianSamples = getRequiredNumberOfSamples();
+        if (numPaths < 0 || normals.size() != static_cast<size_t>(numBrownianSamples) * numPaths)
+            throw std::invalid_argument("WienerProcess: one normal per time step, factor and path is required to generate paths");
+
+        // transpose to the [sample][path] layout that the block is stepped in
+        std::vector<double> brownianSamples(normals.size());
+        for (int ip = 0; ip < numPaths; ++ip)
+            for (int is = 0; is < numBrownianSamples; ++is)
+                brownianSamples[static_cast<size_t>(is) * numPaths + ip] = normals[static_cast<size_t>(ip) * numBrownianSamples + is];
+        return generatePathBlock(brownianSamples, numPaths);
+    }
+
+    // threads running the tasks of one level after another,
+    // started once per block rather than once per level and step
+    class WienerProcess::EvaluationPool {
+    public:
+        explicit EvaluationPool(int numThreads) {
+            for (int ithread = 1; ithread < numThreads; ++ithread)
+                m_threads.emplace_back([this, ithread]() { work(ithread); });
+        }
+
+        ~EvaluationPool() {
             {
-                StateVariable x = StateVariable(isvd + 1);
-                auto svd = m_stateVariableDefns.at(isvd);
-
-                // variable is a function of the current state
-                if (svd->currentStateFunction)
-                    curState.setValue(x, svd->currentStateFunction(t, curState));
-
-                // variable is an ito process
-                // incrementing on the previous state value
-                // based on the drift and volatility
-                else if (svd->drift || svd->volatility){
-                    double prevValue = prevState.getValue(x);
-                    double driftIncrement = 0;
-                    double volIncrement = 0;
-                    if (svd->drift) {
-                        driftIncrement = dt * svd->drift(t, prevState);
-                    }
-                    if (svd->volatility) {
-                        volIncrement = dW * svd->volatility(t, prevState);
-                    }
-                    curState.setValue(x, prevValue + driftIncrement + volIncrement);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_isStopping = true;
+            }
+            m_start.notify_all();
+            for (auto & thread : m_threads)
+                thread.join();
+        }
+
+        int getNumThreads() const { return m_threads.size() + 1; }
+
+        // runs task(0), ..., task(numTasks - 1), task 0 on the calling thread, and waits for all of them
+        void run(int numTasks, const std::function<void(int)> & task) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_task = &task;
+                m_numTasks = numTasks;
+                m_numRunning = numTasks - 1;
+                ++m_generation;
+            }
+            m_start.notify_all();
+            std::exception_ptr error;
+            try {
+                task(0);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this]() { return m_numRunning == 0; });
+            if (!error)
+                error = m_error;
+            m_error = nullptr;
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+    private:
+        void work(int itask) {
+            std::uint64_t generation = 0;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                m_start.wait(lock, [&]() { return m_isStopping || m_generation != generation; });
+                if (m_isStopping)
+                    return;
+                generation = m_generation;
+                if (itask >= m_numTasks)
+                    continue;
+                lock.unlock();
+                std::exception_ptr error;
+                try {
+                    (*m_task)(itask);
+                } catch (...) {
+                    error = std::current_exception();
                 }
+                lock.lock();
+                if (error && !m_error)
+                    m_error = error;
+                if (--m_numRunning == 0)
+                    m_done.notify_one();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        const std::function<void(int)> * m_task = nullptr;
+        int m_numTasks = 0;
+        int m_numRunning = 0;
+        std::uint64_t m_generation = 0;
+        bool m_isStopping = false;
+        std::exception_ptr m_error;
+    };
+
+    std::unique_ptr<WienerProcess::EvaluationPool> WienerProcess::createEvaluationPool(int numPaths) const {
+        // only when some level is wide enough to be evaluated on several threads
+        int levelBegin = 0;
+        for (int levelEnd : m_levelEnds) {
+            int levelWidth = levelEnd - levelBegin;
+            if (std::min(m_numEvaluationThreads, levelWidth) > 1 && static_cast<long>(levelWidth) * numPaths >= ParallelEvaluationThreshold)
+                return std::make_unique<EvaluationPool>(std::min(m_numEvaluationThreads, levelWidth));
+            levelBegin = levelEnd;
+        }
+        return nullptr;
+    }
+
+    PathBlockCPtr WienerProcess::generatePathBlock(const std::vector<double> & brownianSamples, int numPaths) const {
+        auto block = std::make_shared<PathBlock>(m_timeGrid, numPaths, m_initialValue.size());
+        fillPathBlock(brownianSamples.data(), *block, 0, numPaths);
+        return block;
+    }
+
+    void WienerProcess::fillPathBlock(
+            const double * brownianSamples,
+            PathBlock & block,
+            int pathBegin,
+            int pathEnd) const
+    {
+        int numPaths = pathEnd - pathBegin;
+        std::vector<double> bridgedSamples;
+        if (m_brownianBridge) {
+            bridgedSamples.assign(brownianSamples, brownianSamples + static_cast<size_t>(getRequiredNumberOfSamples()) * numPaths);
+            constructBrownianSamples(bridgedSamples.data(), numPaths);
+            brownianSamples = bridgedSamples.data();
+        }
+
+        // set initial state
+        // variables that are not computed keep their initial value all along the paths
+        int stateSize = m_initialValue.size();
+        int numTimes = m_timeGrid->getNumTimes();
+        for (int i = 0; i < stateSize; ++i) {
+            for (int it = 0; it < (m_isComputed[i] ? std::min(numTimes, 1) : numTimes); ++it) {
+                double * x0 = block.getValues(it, StateVariable(i)) + pathBegin;
+                std::fill(x0, x0 + numPaths, m_initialValue[i]);
             }
+        }
 
+        // loop over time incrementally, advancing all paths at each step
+        auto pool = createEvaluationPool(numPaths);
+        std::vector<double> dW(static_cast<size_t>(m_numFactors) * numPaths); // [factor][path]
+        visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+            for (int it = 1; it < numTimes; ++it)
+            {
+                // get the next wiener values for all factors and paths
+                const double * z = brownianSamples + static_cast<size_t>(it - 1) * m_numFactors * numPaths;
+                correlateIncrements(z, getSampleScale(timeGrid.getSqrtDtAtIndex(it)), dW.data(), numPaths);
+                advanceBlock(
+                        it, timeGrid.getTimeAtIndex(it), timeGrid.getDtAtIndex(it), dW.data(),
+                        block.getValues(it - 1, StateVariable(0)) + pathBegin,
+                        block.getValues(it, StateVariable(0)) + pathBegin,
+                        block.getNumPaths(),
+                        numPaths,
+                        pool.get());
+            }
+        });
+    }
+
+    void WienerProcess::fillObservedPathBlock(
+            const double * brownianSamples,
+            const std::vector<int> & observationIndices,
+            PathBlock & block,
+            int pathBegin,
+            int pathEnd) const
+    {
+        if (observationIndices.empty())
+            return;
+        int numPaths = pathEnd - pathBegin;
+        std::vector<double> bridgedSamples;
+        if (m_brownianBridge) {
+            bridgedSamples.assign(brownianSamples, brownianSamples + static_cast<size_t>(getRequiredNumberOfSamples()) * numPaths);
+            constructBrownianSamples(bridgedSamples.data(), numPaths);
+            brownianSamples = bridgedSamples.data();
         }
 
-        return path;
+        // the previous and the current state of all the paths, laid out as [variable][path]
+        // variables that are not computed keep their initial value in both
+        int stateSize = m_initialValue.size();
+        std::vector<double> prevValues(static_cast<size_t>(stateSize) * numPaths), curValues(prevValues.size());
+        for (int i = 0; i < stateSize; ++i) {
+            std::fill(prevValues.begin() + static_cast<size_t>(i) * numPaths, prevValues.begin() + static_cast<size_t>(i + 1) * numPaths, m_initialValue[i]);
+            std::fill(curValues.begin() + static_cast<size_t>(i) * numPaths, curValues.begin() + static_cast<size_t>(i + 1) * numPaths, m_initialValue[i]);
+        }
+        size_t iobs = 0;
+        auto observe = [&](const std::vector<double> & values) {
+            for (int i = 0; i < stateSize; ++i)
+                std::copy_n(values.data() + static_cast<size_t>(i) * numPaths, numPaths, block.getValues(iobs, StateVariable(i)) + pathBegin);
+            ++iobs;
+        };
+        if (observationIndices[0] == 0)
+            observe(prevValues);
+
+        // step all the paths up to the last observation only
+        auto pool = createEvaluationPool(numPaths);
+        std::vector<double> dW(static_cast<size_t>(m_numFactors) * numPaths); // [factor][path]
+        int lastIndex = observationIndices.back();
+        visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+            for (int it = 1; it <= lastIndex; ++it)
+            {
+                const double * z = brownianSamples + static_cast<size_t>(it - 1) * m_numFactors * numPaths;
+                correlateIncrements(z, getSampleScale(timeGrid.getSqrtDtAtIndex(it)), dW.data(), numPaths);
+                advanceBlock(
+                        it, timeGrid.getTimeAtIndex(it), timeGrid.getDtAtIndex(it), dW.data(),
+                        prevValues.data(), curValues.data(), numPaths, numPaths, pool.get());
+                if (observationIndices[iobs] == it)
+                    observe(curValues);
+                std::swap(prevValues, curValues);
+            }
+        });
     }
 
+    void WienerProcess::advanceBlock(
+            int it,
+            Time t,
+            Time dt,
+            const double * dW,
+            double * prevValues,
+            double * curValues,
+            std::size_t stride,
+            int numPaths,
+            EvaluationPool * pool) const
+    {
+        for (int f = 0; f < m_numFactors; ++f) {
+            const double * wPrev = prevValues + f * stride;
+            double * wCur = curValues + f * stride;
+            const double * dWf = dW + static_cast<size_t>(f) * numPaths;
+            for (int ip = 0; ip < numPaths; ++ip)
+                wCur[ip] = wPrev[ip] + dWf[ip];
+        }
+
+        // compute all the derived variables, one variable across all paths at a time
+        int stateSize = m_initialValue.size();
+        auto advanceOp = [&](int iplan) {
+            const StepOp & op = m_stepOps[m_stepPlan[iplan]];
+            if (op.batchFunction) {
+                advanceVariableBatch(op, t, dt, dW + static_cast<size_t>(op.factor) * numPaths, prevValues, curValues, stride, numPaths);
+                return;
+            }
+            for (int ip = 0; ip < numPaths; ++ip) {
+                const StateView prevState(prevValues + ip, stateSize, stride);
+                StateView curState(curValues + ip, stateSize, stride);
+                advanceVariable(op, it, t, dt, dW + ip, numPaths, prevState, curState);
+            }
+        };
+        int levelBegin = 0;
+        for (int levelEnd : m_levelEnds) {
+            // the ops of a level write disjoint rows and only read rows of lower levels,
+            // so they can run concurrently when there is enough work to pay for the threads
+            int levelWidth = levelEnd - levelBegin;
+            int numTasks = pool ? std::min(pool->getNumThreads(), levelWidth) : 1;
+            if (numTasks > 1 && static_cast<long>(levelWidth) * numPaths >= ParallelEvaluationThreshold) {
+                pool->run(numTasks, [&, levelBegin, levelEnd, numTasks](int itask) {
+                    for (int iplan = levelBegin + itask; iplan < levelEnd; iplan += numTasks)
+                        advanceOp(iplan);
+                });
+            } else {
+                for (int iplan = levelBegin; iplan < levelEnd; ++iplan)
+                    advanceOp(iplan);
+            }
+            levelBegin = levelEnd;
+        }
+    }
 
 }
@@ -27,9 +27,15 @@ SOFTWARE.
 #define INTEREST_RATE_MODELLING_WIENER_PROCESS_H
 
 #include "fwd_decl.h"
+#include "expression.h"
+#include "state.h"
 
+#include <array>
+#include <cstddef>
+#include <utility>
 #include <vector>
 #include <functional>
+#include <memory>
 
 namespace irm {
 
@@ -41,6 +47,8 @@ namespace irm {
      * The index is the position of the value of the derived random variable in a generate state.
      * A derived random variable can depend on previously defined random variables using their indices.
      * A derived random variable can also be an Ito process.
+     * The process can also be driven by several correlated wiener processes (factors),
+     *   factor f being the state variable of index f, the Ito processes loading on any of them.
      */
     class WienerProcess {
     public:
@@ -48,14 +56,51 @@ namespace irm {
         /** Constructor
          *
          * @param timeVector The time points in the generate state space.
+         *                   The process works on a frozen copy (see ITimeGrid::freeze),
+         *                   so later changes to timeVector do not affect it.
          * @param initialValue The initial value of the wiener process.
          */
         WienerProcess(ITimeVectorCPtr timeVector, double initialValue);
 
+        /** Constructor of a process driven by several correlated wiener processes
+         *
+         * @param timeVector The time points in the generate state space, as above.
+         * @param initialValues The initial value of each factor, factor f being the state variable of index f.
+         * @param correlation The correlation matrix of the factors, factorized once here.
+         *                    Throws std::invalid_argument if it is not a symmetric positive semi-definite
+         *                      matrix with a unit diagonal, of the size of initialValues.
+         */
+        WienerProcess(ITimeVectorCPtr timeVector, std::vector<double> initialValues, const std::vector<std::vector<double>> & correlation);
+
+        /** The number of wiener processes driving the process, 1 unless a correlation matrix was given. */
+        int getNumFactors() const { return m_numFactors; }
+
+        /** The frozen time grid the process is generated on. */
+        const ITimeGridCPtr & getTimeGrid() const { return m_timeGrid; }
+
+        /** A copy of the process, with the same variables and settings, generated on another time vector.
+         * Eg. to run the same definition on a hierarchy of time grids (see MultilevelMonteCarlo).
+         */
+        WienerProcessPtr createOnTimeVector(ITimeVectorCPtr timeVector) const;
+
         /**
          * StateFunction: T x \Omega -> \Re
+         * Functions written against const IState & are accepted as well,
+         * but taking the final StateView lets state reads be inlined.
          */
-        typedef std::function< double( Time, const IState & ) > StateFunction;
+        typedef std::function< double( Time, const StateView & ) > StateFunction;
+
+        /**
+         * BatchFunction: evaluates a function on numPaths states at once, writing out[p] for path p.
+         * The value of variable i of path p is values[i * stride + p].
+         */
+        typedef std::function< void( Time, const double * values, std::size_t stride, int numPaths, double * out ) > BatchFunction;
+
+        /** The volatility of an Ito process with respect to one factor. */
+        struct FactorLoading {
+            int factor;
+            StateFunction volatility;
+        };
 
 
         /** Function to add a state variable whose value is defined by other variables in the current state.
@@ -67,6 +112,13 @@ namespace irm {
          */
         StateVariable addDerivedStateVariable(StateFunction variableDefinition, double initialValue);
 
+        /** Same as addDerivedStateVariable(variableDefinition, initialValue),
+         *   declaring the state variables the definition reads.
+         * Variables added without declared dependencies are assumed to read every other variable.
+         * @param dependencies The previously defined variables read by variableDefinition.
+         */
+        StateVariable addDerivedStateVariable(StateFunction variableDefinition, double initialValue, std::vector<StateVariable> dependencies);
+
         /** Function to add an Ito process X defined as [ dX   =   dtMultipler * dt   +   dwMultiplier * dW ]
          *
          * @param drift The nultiplier to dt, defined on the previous state
@@ -76,6 +128,108 @@ namespace irm {
          */
         StateVariable addItoIntegralProcess(StateFunction drift, StateFunction volatility, double initialValue);
 
+        /** Function to add an Ito process X defined as [ dX   =   drift * dt   +   sum_f volatility_f * dW_f ]
+         * The other addItoIntegralProcess functions load on factor 0 only.
+         * @param drift The multiplier to dt, defined on the previous state
+         * @param loadings The multiplier to the increment of each factor, defined on the previous state.
+         *                 Throws std::invalid_argument if a factor is out of range.
+         * @param initialValue The initial value of the variable at the start of all paths.
+         */
+        StateVariable addItoIntegralProcess(StateFunction drift, std::vector<FactorLoading> loadings, double initialValue);
+
+        /** Same as addItoIntegralProcess(drift, loadings, initialValue),
+         *   declaring the state variables the drift and volatilities read.
+         */
+        StateVariable addItoIntegralProcess(StateFunction drift, std::vector<FactorLoading> loadings, double initialValue, std::vector<StateVariable> dependencies);
+
+        /** Same as addItoIntegralProcess(drift, volatility, initialValue),
+         *   declaring the state variables the drift and volatility read.
+         * @param dependencies The previously defined variables (or the new variable itself)
+         *                     read by the drift and volatility.
+         */
+        StateVariable addItoIntegralProcess(StateFunction drift, StateFunction volatility, double initialValue, std::vector<StateVariable> dependencies);
+
+        /** Discretisation schemes of a single factor Ito process X [ dX = drift * dt + volatility * dW ]. */
+        enum class ItoScheme {
+            Euler,      // prev + dt * drift + dW * volatility (the default)
+            Milstein,   // Euler + 0.5 * volatility * dVolatility/dX * (dW^2 - dt)
+            LogEuler    // Euler on log X, for positive processes:
+                        //   prev * exp((drift / prev - 0.5 * (volatility / prev)^2) * dt + volatility / prev * dW)
+        };
+
+        /** Function to choose the discretisation scheme of a single factor Ito process.
+         * Throws std::invalid_argument if x is not a single factor Ito process with a volatility.
+         * @param x The Ito process, as returned by addItoIntegralProcess.
+         * @param scheme The scheme to step the process with.
+         * @param volatilityDerivative For Milstein, the derivative of the volatility with respect to x.
+         *                             If empty, it is estimated by central finite differences,
+         *                               at the cost of two more volatility evaluations per step.
+         */
+        void setItoScheme(StateVariable x, ItoScheme scheme, StateFunction volatilityDerivative = StateFunction());
+
+        /** Function to add a geometric brownian motion [ dX = drift * X * dt + volatility * X * dW ],
+         *   sampled from its exact transition, whatever the time step:
+         *   X(t + dt) = X(t) * exp((drift - 0.5 * volatility^2) * dt + volatility * dW).
+         * @param factor The factor of dW.
+         */
+        StateVariable addGeometricBrownianMotion(double drift, double volatility, double initialValue, int factor = 0);
+
+        /** Function to add an Ornstein-Uhlenbeck process [ dX = meanReversion * (longTermMean - X) * dt + volatility * dW ],
+         *   sampled from its exact gaussian transition, whatever the time step:
+         *   X(t + dt) = longTermMean + (X(t) - longTermMean) * exp(-meanReversion * dt) + stdDev(dt) / sqrt(dt) * dW.
+         * The transition coefficients are computed once per step of the time grid.
+         * @param factor The factor of dW.
+         */
+        StateVariable addOrnsteinUhlenbeckProcess(double meanReversion, double longTermMean, double volatility, double initialValue, int factor = 0);
+
+        /** Same as addDerivedStateVariable(variableDefinition, initialValue), for a definition given as an expression.
+         * Batched generation evaluates the expression across all paths in one fused loop,
+         *   and the dependencies are read off the expression.
+         */
+        template<typename Definition>
+        StateVariable addDerivedStateVariable(const expr::Expression<Definition> & variableDefinition, double initialValue);
+
+        /** Same as addItoIntegralProcess(drift, volatility, initialValue), for a drift and volatility given as expressions.
+         * Batched generation evaluates the expressions across all paths in one fused loop,
+         *   and the dependencies are read off the expressions.
+         */
+        template<typename Drift, typename Volatility>
+        StateVariable addItoIntegralProcess(const expr::Expression<Drift> & drift, const expr::Expression<Volatility> & volatility, double initialValue);
+
+        /** The state variable that the next variable added to the process will be.
+         * Useful for Ito processes whose drift or volatility read the process itself.
+         */
+        StateVariable getNextStateVariable() const { return StateVariable(m_initialValue.size()); }
+
+        /** Function to restrict the computation to the given variables and the variables they depend on.
+         * The other variables are not computed, and keep their initial value along every path.
+         * An empty list (the default) means all the variables are computed.
+         */
+        void setOutputVariables(std::vector<StateVariable> outputs);
+
+        /** Whether the variable is computed, given the output variables. */
+        bool isComputed(StateVariable x) const;
+
+        /** How the wiener process is built from the standard normals of a path. */
+        enum class PathConstruction {
+            Incremental,    // normal i drives the increment of step i + 1, in time order (the default)
+            BrownianBridge  // normal 0 drives the terminal value, the next ones the midpoints (see BrownianBridge)
+        };
+
+        /** Function to choose how the wiener process is built from the normals of each path.
+         * The distribution of the paths is the same either way, but a brownian bridge puts most of the variance
+         *   in the first normals, which improves the convergence of quasi random normals.
+         * The other variables are computed from the wiener increments in the same way in both cases.
+         */
+        void setPathConstruction(PathConstruction construction);
+        PathConstruction getPathConstruction() const;
+
+        /** Function to let generatePaths evaluate independent variables of a step on several threads.
+         * The threads are started once per block of paths and shared by all its steps.
+         * Only worth it for large blocks of expensive variables, the default being a single thread.
+         */
+        void setNumEvaluationThreads(int numThreads);
+
         /**
          * Function to generate a single path of all the random variable in the state
          * @tparam RandomNumberGenerator The type of the random number generator
@@ -91,27 +245,280 @@ namespace irm {
         template<typename RandomNumberGenerator>
         IPathCPtr generatePath(RandomNumberGenerator & randomNumberGenerator) const;
 
+        /**
+         * Function to generate several paths at once into a single PathBlock
+         * @tparam RandomNumberGenerator The type of the random number generator
+         * @param randomNumberGenerator The random number generator for generating the paths
+         * @param numPaths The number of paths to generate
+         * @return Returns a block of paths, indexed by path, time and state variable.
+         *         Path i of the block is the path that the (i+1)-th consecutive call to
+         *           generatePath(randomNumberGenerator) would have produced.
+         */
+        template<typename RandomNumberGenerator>
+        PathBlockCPtr generatePaths(RandomNumberGenerator & randomNumberGenerator, int numPaths) const;
+
+        /**
+         * Function to generate antithetic pairs of paths into a single PathBlock
+         * Each pair is driven by one draw of normals: the first path by the normals,
+         *   the second (its mirror path) by the negated normals.
+         * @param randomNumberGenerator The random number generator for generating the paths
+         * @param numPairs The number of pairs to generate
+         * @return Returns a block of 2 * numPairs paths, paths 2k and 2k + 1 being pair k,
+         *         so that estimators can average each pair before averaging over pairs.
+         *         Path 2k is the path that the (k+1)-th consecutive call to
+         *           generatePath(randomNumberGenerator) would have produced.
+         */
+        template<typename RandomNumberGenerator>
+        PathBlockCPtr generateAntitheticPaths(RandomNumberGenerator & randomNumberGenerator, int numPairs) const;
+
+        /**
+         * Function to generate a single path with adaptive time stepping
+         * Each step of the time vector is checked by step doubling: if one step and two half steps differ
+         *   by more than the tolerance, both halves are refined in the same way, down to maxDepth halvings.
+         * The wiener process is subdivided by brownian bridge, drawing the normals of the midpoints from
+         *   randomNumberGenerator after those of the time vector, so the path stays the same brownian path
+         *   at the points of the time vector, whatever the refinement.
+         * The step doubling estimate of the diffusion terms is itself random,
+         *   so the largest savings are for stiff or fast varying drifts.
+         * @param randomNumberGenerator The random number generator for generating the path
+         * @param tolerance The largest difference allowed between one step and two half steps,
+         *                  relative to 1 + |value|, over the computed variables.
+         * @param maxDepth The most halvings of a step of the time vector.
+         * @param numSteps If not null, set to the number of steps evaluated, those of the step doubling checks included.
+         * @return Returns a path on the time vector of the process, whose wiener values are those of
+         *           generatePath(randomNumberGenerator) (up to rounding).
+         */
+        template<typename RandomNumberGenerator>
+        IPathCPtr generateAdaptivePath(RandomNumberGenerator & randomNumberGenerator, double tolerance, int maxDepth = 10, int * numSteps = nullptr) const;
+
+        /** The number of standard normals consumed by each path, one per time step and factor. */
+        int getRequiredNumberOfSamples() const;
+
+        /**
+         * Function to generate a single path from caller supplied standard normals
+         * Separates the sampling of the normals from the construction of the path,
+         *   eg. to generate paths from a quasi random sequence (see SobolSequence).
+         * @param normals The getRequiredNumberOfSamples() standard normals driving the path,
+         *                normals[i * getNumFactors() + f] driving the increment of factor f at step i + 1,
+         *                before correlation.
+         *                Throws std::invalid_argument if the size does not match.
+         * @return Returns the path, generatePath(randomNumberGenerator) being
+         *         generatePathFromNormals of the next normals drawn from randomNumberGenerator.
+         */
+        IPathCPtr generatePathFromNormals(const std::vector<double> & normals) const;
+
+        /**
+         * Function to generate several paths at once from caller supplied standard normals
+         * @param normals The normals of each path in turn, those of path i starting at normals[i * getRequiredNumberOfSamples()].
+         *                Throws std::invalid_argument if the size does not match.
+         * @param numPaths The number of paths to generate
+         * @return Returns a block whose path i is generatePathFromNormals of the normals of path i.
+         */
+        PathBlockCPtr generatePathsFromNormals(const std::vector<double> & normals, int numPaths) const;
+
+        /**
+         * Function to simulate a single path without ever materializing it
+         * Only the previous and the current state are kept in memory,
+         *   and the normals are drawn on the fly in small batches.
+         * @tparam RandomNumberGenerator The type of the random number generator
+         * @tparam Visitor Callable as visitor(int timeIndex, Time t, const StateView & state)
+         * @param randomNumberGenerator The random number generator for generating the path
+         * @param visitor Called on every state of the path in time order, starting with the initial state.
+         *                The state is only valid for the duration of the call.
+         *                The states visited are the states of the path that
+         *                  generatePath(randomNumberGenerator) would have produced.
+         */
+        template<typename RandomNumberGenerator, typename Visitor>
+        void simulate(RandomNumberGenerator & randomNumberGenerator, Visitor && visitor) const;
+
+        /**
+         * Function to generate a single path, keeping only the states at the observation indices
+         * The path is stepped through the full time vector,
+         *   but only the requested states are stored.
+         * @param randomNumberGenerator The random number generator for generating the path
+         * @param observationIndices Strictly increasing indices into the time vector of the process
+         *                           (see findTimeIndices to get them from observation times).
+         * @return Returns a path with one state per observation index,
+         *         equal to the states of generatePath(randomNumberGenerator) at those indices.
+         */
+        template<typename RandomNumberGenerator>
+        IPathCPtr generatePath(RandomNumberGenerator & randomNumberGenerator, const std::vector<int> & observationIndices) const;
+
+        /**
+         * Function to generate several paths at once, keeping only the states at the observation indices
+         * @return Returns a block whose time index i corresponds to observationIndices[i],
+         *         path i being the path that the (i+1)-th consecutive call to
+         *         generatePath(randomNumberGenerator, observationIndices) would have produced.
+         */
+        template<typename RandomNumberGenerator>
+        PathBlockCPtr generatePaths(RandomNumberGenerator & randomNumberGenerator, int numPaths, const std::vector<int> & observationIndices) const;
+
+        /** The time vector made of the times at the observation indices.
+         * Throws std::invalid_argument if the indices are not strictly increasing indices of the time vector.
+         */
+        ITimeVectorCPtr getObservationTimeVector(const std::vector<int> & observationIndices) const;
+
     private:
 
+        friend class MonteCarloEngine;
+
 
         // helper struct
-        struct StateVariableDefn {
-            StateFunction currentStateFunction;
-            StateFunction drift;
-            StateFunction volatility;
+        // one entry of the step plan, computing the value of one state variable at each step
+        // the kind is settled when the variable is added, so the stepping loop never tests
+        // which of the functions are present
+        enum class StepKind {
+            Derived,        // function of the current state
+            Ito,            // prev + dt * drift + dW * volatility
+            DriftOnly,      // prev + dt * drift
+            VolatilityOnly, // prev + dW * volatility
+            Constant,       // prev
+            MultiFactor,    // prev + dt * drift + sum_f dW_f * volatility_f
+            Milstein,       // Ito + 0.5 * volatility * volatilityDerivative * (dW^2 - dt)
+            LogEuler,       // prev * exp((drift / prev - 0.5 * (volatility / prev)^2) * dt + volatility / prev * dW)
+            ExactGeometricBrownian,    // prev * exp(c0 + c1 * dW)
+            ExactOrnsteinUhlenbeck     // level + (prev - level) * c0 + c1 * dW
+        };
+        struct StepOp {
+            StepKind kind = StepKind::Constant;
+            StateVariable variable = StateVariable(0);
+            StateFunction function = {};   // derived function, or drift
+            StateFunction volatility = {};
+            bool hasDeclaredDependencies = false;
+            std::vector<StateVariable> dependencies = {};
+            BatchFunction batchFunction = {};   // optional batched form of function
+            BatchFunction batchVolatility = {}; // optional batched form of volatility
+            int factor = 0;                     // the factor of dW, for Ito and VolatilityOnly
+            std::vector<FactorLoading> loadings = {}; // for MultiFactor
+            StateFunction volatilityDerivative = {};  // for Milstein
+            // for the exact kinds: drift and volatility of a geometric brownian motion,
+            // or mean reversion, long term mean and volatility of an Ornstein-Uhlenbeck process
+            std::array<double, 3> exactParameters{};
+            std::vector<double> stepCoefficients = {}; // c0, c1 of each step of the time grid, for the exact kinds
         };
-        typedef std::shared_ptr<const StateVariableDefn> StateVariableDefnCPtr;
+
+        // threads evaluating the ops of a level concurrently, for the duration of one block
+        class EvaluationPool;
+        // null unless some level is worth evaluating on several threads for numPaths paths
+        std::unique_ptr<EvaluationPool> createEvaluationPool(int numPaths) const;
+
+        template<typename Definition>
+        static BatchFunction createBatchFunction(const expr::Expression<Definition> & definition);
 
 
         // helper functions
-        int getRequiredNumberOfSamples() const;
-        IPathCPtr generatePath(std::vector<double> brownianSamples) const;
+        // brownianSamples are laid out as [sample][path]
+        PathBlockCPtr generatePathBlock(const std::vector<double> & brownianSamples, int numPaths) const;
+        // fills paths [pathBegin, pathEnd) of the block,
+        // brownianSamples being laid out as [sample][path - pathBegin]
+        void fillPathBlock(const double * brownianSamples, PathBlock & block, int pathBegin, int pathEnd) const;
+        // fills paths [pathBegin, pathEnd) of a block on the observation times, stepping up to the last observation
+        void fillObservedPathBlock(
+                const double * brownianSamples,
+                const std::vector<int> & observationIndices,
+                PathBlock & block,
+                int pathBegin,
+                int pathEnd) const;
+        // advances numPaths paths by one step, dW being laid out as [factor][path]
+        // prevValues and curValues point at the first path of the previous and current state,
+        // whose variables are rows stride doubles apart; prevValues is only read
+        void advanceBlock(
+                int it,
+                Time t,
+                Time dt,
+                const double * dW,
+                double * prevValues,
+                double * curValues,
+                std::size_t stride,
+                int numPaths,
+                EvaluationPool * pool) const;
+        // simulate the path, writing the state at observationIndices[i] to observedStates(i)
+        template<typename RandomNumberGenerator, typename ObservedState>
+        void simulateObserved(
+                RandomNumberGenerator & rng,
+                const std::vector<int> & observationIndices,
+                ObservedState && observedStates) const;
+        // in brownian bridge mode, replaces the normals of numPaths paths, laid out as [sample][path],
+        // by the bridged increments of the factors in time order, before correlation
+        void constructBrownianSamples(double * brownianSamples, int numPaths) const;
+        // the scale turning a brownian sample into an increment: sqrt(dt) for normals, 1 for bridged increments
+        double getSampleScale(double sqrtDt) const { return m_brownianBridge ? 1.0 : sqrtDt; }
+        // generateAdaptivePath, the normals of the midpoints being drawn by drawNormals(out, n)
+        IPathCPtr generateAdaptivePathFromNormals(
+                std::vector<double> brownianSamples,
+                const std::function<void(double *, std::size_t)> & drawNormals,
+                double tolerance,
+                int maxDepth,
+                int * numSteps) const;
+        // advances prevState to curState over [t - dt, t] with the factor increments dW,
+        // halving the step at most depth times while the step doubling error is above tolerance
+        // isStepped tells that curState already holds the single step from prevState
+        // scratch holds depth * (4 * numFactors + 2 * stateSize) doubles
+        // returns the number of steps evaluated
+        int advanceAdaptively(
+                int it,
+                Time t,
+                Time dt,
+                const double * dW,
+                const StateView & prevState,
+                StateView & curState,
+                bool isStepped,
+                double * scratch,
+                const std::function<void(double *, std::size_t)> & drawNormals,
+                double tolerance,
+                int depth) const;
+        // correlates the samples of one step, z[g * numPaths + p] being the sample of factor g of path p,
+        // into the increments dW, laid out the same way, scaling them by scale (see getSampleScale)
+        void correlateIncrements(const double * z, double scale, double * dW, int numPaths) const;
+        // dW[f] being the increment of factor f
+        void advanceState(int it, Time t, Time dt, const double * dW, const StateView & prevState, StateView & curState) const;
+        StateVariable addStepOp(StepOp op, double initialValue);
+        StateVariable addExactProcess(StepKind kind, std::array<double, 3> parameters, double initialValue, int factor);
+        // fills the stepCoefficients of an exact kind for the time grid
+        void computeStepCoefficients(StepOp & op) const;
+        // c0, c1 of an exact kind for a step of length dt
+        static std::pair<double, double> computeExactCoefficients(const StepOp & op, Time dt, double sqrtDt);
+        // rebuilds the step plan from the step ops and the output variables
+        void compilePlan();
+        // advances one variable of numPaths paths with the batch functions of the op
+        // prevValues and curValues point at the first value of the first path of the previous and current state,
+        // dW at the increments of the factor of the op
+        static void advanceVariableBatch(
+                const StepOp & op,
+                Time t,
+                Time dt,
+                const double * dW,
+                const double * prevValues,
+                double * curValues,
+                std::size_t stride,
+                int numPaths);
+        // dW[f * dWStride] being the increment of factor f
+        // it being the index of the current time, or -1 for a step off the time grid
+        static void advanceVariable(
+                const StepOp & op,
+                int it,
+                Time t,
+                Time dt,
+                const double * dW,
+                std::size_t dWStride,
+                const StateView & prevState,
+                StateView & curState);
 
 
         // member variables
-        ITimeVectorCPtr m_timeVector;
+        ITimeGridCPtr m_timeGrid;
+        int m_numFactors;
+        std::vector<double> m_cholesky;      // lower triangular factor of the correlation, row-major
         std::vector<double> m_initialValue;
-        std::vector<StateVariableDefnCPtr> m_stateVariableDefns;
+        std::vector<StepOp> m_stepOps;       // one per variable but the factors, in definition order
+        std::vector<StateVariable> m_outputs;
+        // the indices of the ops to compute, grouped by level:
+        // ops of one level only read the previous state or the current state of lower levels
+        std::vector<int> m_stepPlan;
+        std::vector<int> m_levelEnds;        // end of each level in m_stepPlan
+        std::vector<bool> m_isComputed;      // by variable index
+        int m_numEvaluationThreads;
+        BrownianBridgeCPtr m_brownianBridge; // null for the incremental construction
     }; // end class WienerStateSpace
 
 
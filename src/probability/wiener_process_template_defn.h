@@ -26,24 +26,203 @@ SOFTWARE.
 #define INTEREST_RATE_MODELLING_WIENER_PROCESS_TEMPLATE_DEFN_H
 
 #include "wiener_process.h"
+#include "normal_sampler.h"
+#include "path.h"
+#include "path_block.h"
+#include "state.h"
+#include "time.h"
+#include "time_grid.h"
 
-#include <random>
+#include <algorithm>
+#include <cmath>
+#include <utility>
 
 
 
 namespace irm {
 
 
+    template<typename Definition>
+    StateVariable WienerProcess::addDerivedStateVariable(const expr::Expression<Definition> & variableDefinition, double initialValue)
+    {
+        StateVariable x = addDerivedStateVariable(StateFunction(variableDefinition.derived()), initialValue, variableDefinition.getVariables());
+        m_stepOps.back().batchFunction = createBatchFunction(variableDefinition);
+        return x;
+    }
+
+
+    template<typename Drift, typename Volatility>
+    StateVariable WienerProcess::addItoIntegralProcess(
+            const expr::Expression<Drift> & drift,
+            const expr::Expression<Volatility> & volatility,
+            double initialValue)
+    {
+        std::vector<StateVariable> dependencies = drift.getVariables();
+        for (StateVariable x : volatility.getVariables())
+            dependencies.push_back(x);
+        StateVariable x = addItoIntegralProcess(StateFunction(drift.derived()), StateFunction(volatility.derived()), initialValue, std::move(dependencies));
+        m_stepOps.back().batchFunction = createBatchFunction(drift);
+        m_stepOps.back().batchVolatility = createBatchFunction(volatility);
+        return x;
+    }
+
+
+    template<typename Definition>
+    WienerProcess::BatchFunction WienerProcess::createBatchFunction(const expr::Expression<Definition> & definition)
+    {
+        return [e = definition.derived()](Time t, const double * values, std::size_t stride, int numPaths, double * out) {
+            for (int ip = 0; ip < numPaths; ++ip)
+                out[ip] = e.evaluate(t, values + ip, stride);
+        };
+    }
+
+
     template<typename RandomNumberGenerator>
     IPathCPtr WienerProcess::generatePath(RandomNumberGenerator & rng) const
     {
-        std::normal_distribution nd;
-        std::vector<double> brownianSample;
+        std::vector<double> brownianSample(getRequiredNumberOfSamples());
+        NormalSampler::fill(rng, brownianSample.data(), brownianSample.size());
+        return generatePathFromNormals(brownianSample);
+    }
+
+
+    template<typename RandomNumberGenerator>
+    PathBlockCPtr WienerProcess::generatePaths(RandomNumberGenerator & rng, int numPaths) const
+    {
+        int numBrownianSamples = getRequiredNumberOfSamples();
+        std::vector<double> brownianSamples(static_cast<size_t>(numBrownianSamples) * numPaths);
+        // draw path by path, so that the block matches consecutive calls to generatePath
+        for (int ip = 0; ip < numPaths; ++ip)
+            NormalSampler::fillStrided(rng, brownianSamples.data() + ip, numBrownianSamples, numPaths);
+        return generatePathBlock(brownianSamples, numPaths);
+    }
+
+
+
+    template<typename RandomNumberGenerator>
+    PathBlockCPtr WienerProcess::generateAntitheticPaths(RandomNumberGenerator & rng, int numPairs) const
+    {
+        int numBrownianSamples = getRequiredNumberOfSamples();
+        int numPaths = 2 * numPairs;
+        std::vector<double> brownianSamples(static_cast<size_t>(numBrownianSamples) * numPaths);
+        for (int ipair = 0; ipair < numPairs; ++ipair) {
+            double * samples = brownianSamples.data() + 2 * ipair;
+            NormalSampler::fillStrided(rng, samples, numBrownianSamples, numPaths);
+            for (int is = 0; is < numBrownianSamples; ++is)
+                samples[static_cast<size_t>(is) * numPaths + 1] = -samples[static_cast<size_t>(is) * numPaths];
+        }
+        return generatePathBlock(brownianSamples, numPaths);
+    }
+
+
+    template<typename RandomNumberGenerator>
+    IPathCPtr WienerProcess::generateAdaptivePath(RandomNumberGenerator & rng, double tolerance, int maxDepth, int * numSteps) const
+    {
+        std::vector<double> brownianSamples(getRequiredNumberOfSamples());
+        NormalSampler::fill(rng, brownianSamples.data(), brownianSamples.size());
+        return generateAdaptivePathFromNormals(
+                std::move(brownianSamples),
+                [&rng](double * normals, std::size_t n) { NormalSampler::fill(rng, normals, n); },
+                tolerance,
+                maxDepth,
+                numSteps);
+    }
+
+
+    template<typename RandomNumberGenerator, typename Visitor>
+    void WienerProcess::simulate(RandomNumberGenerator & rng, Visitor && visitor) const
+    {
+        int numTimes = m_timeGrid->getNumTimes();
+        if (numTimes == 0)
+            return;
+
+        // two states, swapped after every step
+        int stateSize = m_initialValue.size();
+        std::vector<double> prevValues(m_initialValue), curValues(m_initialValue);
+        StateView prevState(prevValues.data(), stateSize, 1);
+        StateView curState(curValues.data(), stateSize, 1);
+
+        // normals are drawn in batches of whole steps, small enough to stay in L1
+        const int StepsPerBatch = std::max(1, 64 / m_numFactors);
+        int numSteps = numTimes - 1;
+        std::vector<double> normals(static_cast<size_t>(std::min(StepsPerBatch, numSteps)) * m_numFactors);
+        std::vector<double> dW(m_numFactors);
+        const double * z = nullptr;
+        // except for a brownian bridge, which needs all the normals of the path at once
+        if (m_brownianBridge) {
+            normals.resize(getRequiredNumberOfSamples());
+            NormalSampler::fill(rng, normals.data(), normals.size());
+            constructBrownianSamples(normals.data(), 1);
+        }
+
+        visitor(0, m_timeGrid->getTimeAtIndex(0), static_cast<const StateView &>(prevState));
+        visitTimeGrid(*m_timeGrid, [&](const auto & timeGrid) {
+            for (int it = 1; it < numTimes; ++it)
+            {
+                int istep = it - 1;
+                if (m_brownianBridge) {
+                    z = normals.data() + static_cast<size_t>(istep) * m_numFactors;
+                } else if (istep % StepsPerBatch == 0) {
+                    NormalSampler::fill(rng, normals.data(), static_cast<size_t>(std::min(StepsPerBatch, numSteps - istep)) * m_numFactors);
+                    z = normals.data();
+                } else {
+                    z += m_numFactors;
+                }
+                Time t = timeGrid.getTimeAtIndex(it);
+                correlateIncrements(z, getSampleScale(timeGrid.getSqrtDtAtIndex(it)), dW.data(), 1);
+                advanceState(it, t, timeGrid.getDtAtIndex(it), dW.data(), prevState, curState);
+                visitor(it, t, static_cast<const StateView &>(curState));
+                std::swap(prevState, curState);
+            }
+        });
+    }
+
+
+    template<typename RandomNumberGenerator, typename ObservedState>
+    void WienerProcess::simulateObserved(
+            RandomNumberGenerator & rng,
+            const std::vector<int> & observationIndices,
+            ObservedState && observedStates) const
+    {
+        int numValues = m_initialValue.size();
+        size_t iobs = 0;
+        simulate(rng, [&](int it, Time, const StateView & state) {
+            if (iobs < observationIndices.size() && observationIndices[iobs] == it) {
+                auto && observed = observedStates(iobs++);
+                for (int i = 0; i < numValues; ++i)
+                    observed.setValue(StateVariable(i), state.getValue(StateVariable(i)));
+            }
+        });
+    }
+
+
+    template<typename RandomNumberGenerator>
+    IPathCPtr WienerProcess::generatePath(RandomNumberGenerator & rng, const std::vector<int> & observationIndices) const
+    {
+        auto observationTimes = getObservationTimeVector(observationIndices);
+        int stateSize = m_initialValue.size();
+        std::vector<double> values(observationIndices.size() * stateSize);
+        simulateObserved(rng, observationIndices, [&](size_t iobs) {
+            return StateView(values.data() + iobs * stateSize, stateSize, 1);
+        });
+        return IPath::createFromValues(observationTimes, stateSize, std::move(values));
+    }
+
+
+    template<typename RandomNumberGenerator>
+    PathBlockCPtr WienerProcess::generatePaths(
+            RandomNumberGenerator & rng,
+            int numPaths,
+            const std::vector<int> & observationIndices) const
+    {
+        auto observationTimes = getObservationTimeVector(observationIndices);
+        auto block = std::make_shared<PathBlock>(observationTimes, numPaths, m_initialValue.size());
         int numBrownianSamples = getRequiredNumberOfSamples();
-        brownianSample.reserve(numBrownianSamples);
-        for (int i = 0; i < numBrownianSamples; ++i)
-            brownianSample.push_back(nd(rng));
-        return generatePath(std::move(brownianSample));
+        std::vector<double> brownianSamples(static_cast<size_t>(numBrownianSamples) * numPaths);
+        for (int ip = 0; ip < numPaths; ++ip)
+            NormalSampler::fillStrided(rng, brownianSamples.data() + ip, numBrownianSamples, numPaths);
+        fillObservedPathBlock(brownianSamples.data(), observationIndices, *block, 0, numPaths);
+        return block;
     }
 
 
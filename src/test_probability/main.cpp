@@ -23,17 +23,60 @@ SOFTWARE.
 */
 
 #include <iostream>
+#include <atomic>
 #include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
+#include <probability/expression.h>
+#include <probability/brownian_bridge.h>
+#include <probability/monte_carlo_engine.h>
+#include <probability/multilevel_monte_carlo.h>
+#include <probability/normal_sampler.h>
 #include <probability/path.h>
+#include <probability/path_block.h>
+#include <probability/path_exporter.h>
+#include <probability/path_statistics.h>
+#include <probability/path_store.h>
+#include <probability/philox.h>
+#include <probability/scenario_cache.h>
+#include <probability/sobol.h>
 #include <probability/state.h>
+#include <probability/static_process.h>
 #include <probability/time.h>
+#include <probability/time_grid.h>
 #include <probability/wiener_process.h>
 
+void testMonteCarloEngine();
+void testNormalSampler();
 void testPath();
+void testPathBlock();
+void testPhilox();
 void testState();
+void testStaticProcess();
 void testTime();
+void testTimeGrid();
 void testWienerProcess();
+void testSimulate();
+void testObservationIndices();
+void testDependencies();
+void testExpression();
+void testSobol();
+void testBrownianBridge();
+void testAntitheticPaths();
+void testMultiFactor();
+void testItoSchemes();
+void testAdaptivePath();
+void testMultilevelMonteCarlo();
+void testPathStatistics();
+void testGenerateUntilConverged();
+void testPathStore();
+void testPathExporter();
+void testScenarioCache();
 
 
 #define info(x) std::cout << "[test_probability] " << x << std::endl
@@ -51,16 +94,123 @@ bool doubleEquals(double x, double y, double absTol = 1e-100) {
 
 int main() {
     info("Starting");
+    testMonteCarloEngine();
+    testNormalSampler();
     testPath();
+    testPathBlock();
+    testPhilox();
     testState();
+    testStaticProcess();
     testTime();
+    testTimeGrid();
     testWienerProcess();
+    testSimulate();
+    testObservationIndices();
+    testDependencies();
+    testExpression();
+    testSobol();
+    testBrownianBridge();
+    testAntitheticPaths();
+    testMultiFactor();
+    testItoSchemes();
+    testAdaptivePath();
+    testMultilevelMonteCarlo();
+    testPathStatistics();
+    testGenerateUntilConverged();
+    testPathStore();
+    testPathExporter();
+    testScenarioCache();
     info("SUCCESS");
     return 0;
 }
 
 
 
+void testMonteCarloEngine() {
+    using namespace irm;
+    info("testMonteCarloEngine");
+    const int numTimes = 30;
+    const int numPaths = 150;
+    const std::uint64_t seed = 2020;
+    auto process = std::make_shared<WienerProcess>(ITimeVector::createUniform(0, .1, numTimes), 0);
+    StateVariable W(0);
+    StateVariable X = process->addItoIntegralProcess(
+            [&](Time, const StateView & s) { return -s.getValue(W); },
+            [](Time, const StateView &) { return .2; },
+            1);
+
+    auto singleThreaded = MonteCarloEngine(process, numPaths, seed, 1).generatePaths();
+    auto multiThreaded = MonteCarloEngine(process, numPaths, seed, 4).generatePaths();
+    assert(singleThreaded->getNumPaths() == numPaths);
+    assert(multiThreaded->getNumPaths() == numPaths);
+    for (int ip = 0; ip < numPaths; ++ip) {
+        // every path only depends on the seed and its index
+        auto rng = MonteCarloEngine::createPathGenerator(seed, ip);
+        auto path = process->generatePath(rng);
+        for (int it = 0; it < numTimes; ++it) {
+            for (StateVariable x : {W, X}) {
+                double expected = path->getStateAtIndex(it).getValue(x);
+                assert(singleThreaded->getValue(ip, it, x) == expected);
+                assert(multiThreaded->getValue(ip, it, x) == expected);
+            }
+        }
+    }
+}
+
+
+void testNormalSampler() {
+    using namespace irm;
+    info("testNormalSampler");
+
+    // the inverse must round trip through the normal cumulative distribution, tails included
+    auto cumulative = [](double x) { return .5 * std::erfc(-x / std::sqrt(2.0)); };
+    for (double u : {1e-300, 1e-20, 1e-8, 1e-3, .02, .075, .2, .5, .7, .925, .99, 1 - 1e-10}) {
+        double x = NormalSampler::inverseCumulative(u);
+        assert(std::abs(cumulative(x) - u) < 1e-13 * std::max(u, 1e-3));
+        if (u > 1e-12) // 1 - u is not representable accurately below that
+            assert(doubleEquals(NormalSampler::inverseCumulative(1 - u), -x, 1e-6 * std::max(1.0, std::abs(x))));
+    }
+    assert(NormalSampler::inverseCumulative(.5) == 0);
+
+    // bulk conversion matches the scalar inverse
+    std::vector<double> uniforms{.001, .1, .3, .5, .8, .95, .9999};
+    std::vector<double> normals = uniforms;
+    NormalSampler::uniformsToNormals(normals.data(), normals.size());
+    for (size_t i = 0; i < uniforms.size(); ++i)
+        assert(normals[i] == NormalSampler::inverseCumulative(uniforms[i]));
+
+    // one fill or several smaller ones draw the same numbers, for any kind of generator
+    std::vector<double> whole(1000), pieces(1000), strided(2000);
+    PhiloxEngine p1(3), p2(3), p3(3);
+    NormalSampler::fill(p1, whole.data(), 1000);
+    NormalSampler::fill(p2, pieces.data(), 333);
+    NormalSampler::fill(p2, pieces.data() + 333, 667);
+    NormalSampler::fillStrided(p3, strided.data(), 1000, 2);
+    for (int i = 0; i < 1000; ++i)
+        assert(whole[i] == pieces[i] && whole[i] == strided[2 * i]);
+    std::default_random_engine d1(3), d2(3);
+    NormalSampler::fill(d1, whole.data(), 1000);
+    NormalSampler::fill(d2, pieces.data(), 500);
+    NormalSampler::fill(d2, pieces.data() + 500, 500);
+    assert(whole == pieces);
+
+    // moments of a large sample
+    const int numSamples = 200000;
+    std::vector<double> sample(numSamples);
+    PhiloxEngine rng(11);
+    NormalSampler::fill(rng, sample.data(), numSamples);
+    double sum = 0, sumSq = 0;
+    for (double x : sample) {
+        sum += x;
+        sumSq += x * x;
+    }
+    double mean = sum / numSamples;
+    double variance = sumSq / numSamples - mean * mean;
+    assert(std::abs(mean) < 5 / std::sqrt(numSamples));
+    assert(std::abs(variance - 1) < 5 * std::sqrt(2.0 / numSamples));
+}
+
+
 void testPath() {
     using namespace irm;
     info("testPath");
@@ -68,23 +218,114 @@ void testPath() {
     Time t0 = 0, dt = .1;
     auto tv = ITimeVector::createUniform(t0, dt, numTimes);
     int stateSize = 2;
-    auto path = IPath::createZeroPath(tv, stateSize);
-    assert(path->getNumTimes() == numTimes);
-    assert(path->getStateSize() == stateSize);
-    for (int it = 0; it < numTimes; ++it) {
-        assert(path->getStateAtIndex(it).getNumValues() == stateSize);
-        assert(std::static_pointer_cast<const IPath>(path)->getStateAtIndex(it).getNumValues() == stateSize);
-        assert(path->getTimeAtIndex(it) == tv->getTimeAtIndex(it));
-        for (int iv = 0; iv < stateSize; ++iv) {
-            double newValue = it + iv * numTimes;
-            doubleEquals(path->getStateAtIndex(it).getValue(StateVariable(iv)), 0);
-            path->getStateAtIndex(it).setValue(StateVariable(iv), newValue);
-            doubleEquals(path->getStateAtIndex(it).getValue(StateVariable(iv)), newValue);
+    for (PathLayout layout : {PathLayout::RowMajor, PathLayout::ColumnMajor}) {
+        auto path = IPath::createZeroPath(tv, stateSize, layout);
+        assert(path->getNumTimes() == numTimes);
+        assert(path->getStateSize() == stateSize);
+        for (int it = 0; it < numTimes; ++it) {
+            assert(path->getStateAtIndex(it).getNumValues() == stateSize);
+            assert(std::static_pointer_cast<const IPath>(path)->getStateAtIndex(it).getNumValues() == stateSize);
+            assert(path->getTimeAtIndex(it) == tv->getTimeAtIndex(it));
+            for (int iv = 0; iv < stateSize; ++iv) {
+                double newValue = it + iv * numTimes;
+                assert(doubleEquals(path->getStateAtIndex(it).getValue(StateVariable(iv)), 0));
+                path->getStateAtIndex(it).setValue(StateVariable(iv), newValue);
+                assert(doubleEquals(path->getStateAtIndex(it).getValue(StateVariable(iv)), newValue));
+            }
         }
+
+        // states share one buffer, so make sure they do not overlap
+        for (int it = 0; it < numTimes; ++it)
+            for (int iv = 0; iv < stateSize; ++iv)
+                assert(doubleEquals(path->getStateAtIndex(it).getValue(StateVariable(iv)), it + iv * numTimes));
     }
 }
 
 
+void testPathBlock() {
+    using namespace irm;
+    info("testPathBlock");
+    const int numTimes = 50;
+    const int numPaths = 7;
+    WienerProcess process(ITimeVector::createUniform(0, .01, numTimes), 1);
+    StateVariable W(0);
+    auto drift = [&](Time, const IState & X) { return .5 * X.getValue(W); };
+    auto vol = [](Time, const IState &) { return .3; };
+    StateVariable X = process.addItoIntegralProcess(drift, vol, 2);
+    StateVariable Y = process.addDerivedStateVariable(
+            [&](Time t, const IState & s) { return s.getValue(X) * t; }, 0);
+
+    std::default_random_engine blockRng(42), pathRng(42);
+    auto block = process.generatePaths(blockRng, numPaths);
+    assert(block->getNumPaths() == numPaths);
+    assert(block->getNumTimes() == numTimes);
+    assert(block->getStateSize() == 3);
+
+    // a block must contain exactly the paths generated one at a time
+    for (int ip = 0; ip < numPaths; ++ip) {
+        auto path = process.generatePath(pathRng);
+        auto view = block->getPath(ip);
+        assert(view->getNumTimes() == numTimes);
+        for (int it = 0; it < numTimes; ++it) {
+            assert(doubleEquals(block->getTimeAtIndex(it), path->getTimeAtIndex(it)));
+            for (StateVariable x : {W, X, Y}) {
+                double expected = path->getStateAtIndex(it).getValue(x);
+                assert(block->getValue(ip, it, x) == expected);
+                assert(view->getStateAtIndex(it).getValue(x) == expected);
+                assert(block->getValues(it, x)[ip] == expected);
+            }
+        }
+    }
+}
+
+
+void testPhilox() {
+    using namespace irm;
+    info("testPhilox");
+
+    // reference vectors of the Random123 distribution
+    typedef PhiloxEngine::Counter Counter;
+    assert((PhiloxEngine::generateBlock(Counter{0, 0, 0, 0}, {0, 0})
+            == Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+    assert((PhiloxEngine::generateBlock(Counter{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff})
+            == Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+    assert((PhiloxEngine::generateBlock(Counter{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0})
+            == Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+
+    // sequential draws, jumps and bulk fills must agree
+    PhiloxEngine sequential(123, 4);
+    std::vector<std::uint64_t> expected(21);
+    for (auto & x : expected)
+        x = sequential();
+    for (std::uint64_t offset = 0; offset < expected.size(); ++offset) {
+        PhiloxEngine jumped(123, 0);
+        jumped.seek(4, offset);
+        assert(jumped.getOffset() == offset);
+        assert(jumped() == expected[offset]);
+
+        PhiloxEngine discarded(123, 4);
+        discarded.discard(offset);
+        assert(discarded() == expected[offset]);
+
+        PhiloxEngine filled(123, 4);
+        std::vector<std::uint64_t> head(offset), tail(expected.size() - offset);
+        filled.fill(head.data(), head.size());
+        filled.fill(tail.data(), tail.size());
+        head.insert(head.end(), tail.begin(), tail.end());
+        assert(head == expected);
+    }
+
+    // different streams and seeds give different numbers
+    assert(PhiloxEngine(123, 5)() != expected[0]);
+    assert(PhiloxEngine(124, 4)() != expected[0]);
+
+    // usable as the generator of a path
+    WienerProcess process(ITimeVector::createUniform(0, .1, 10), 0);
+    PhiloxEngine rng(1, 2);
+    assert(process.generatePath(rng)->getNumTimes() == 10);
+}
+
+
 void testState() {
     using namespace irm;
     info("testState");
@@ -108,6 +349,58 @@ void testState() {
         customState->setValue(si, i);
         assert(doubleEquals(customState->getValue(si), i));
     }
+
+    // a view with stride 2 sees every other value of the buffer
+    std::vector<double> buffer{0, 10, 1, 11, 2, 12};
+    StateView view(buffer.data(), 3, 2);
+    const IState & viewAsState = view;
+    assert(view.getNumValues() == 3);
+    for (int i = 0; i < 3; ++i) {
+        StateVariable si(i);
+        assert(doubleEquals(view.getValue(si), i));
+        assert(doubleEquals(viewAsState.getValue(si), i));
+        view.setValue(si, -i);
+        assert(doubleEquals(buffer[2 * i], -i));
+        assert(doubleEquals(buffer[2 * i + 1], 10 + i));
+    }
+}
+
+
+void testStaticProcess() {
+    using namespace irm;
+    info("testStaticProcess");
+    const int numTimes = 200;
+    const double mu = .1, sigma = .25;
+    auto tv = ITimeVector::createUniform(0, .005, numTimes);
+    StateVariable W(0), GB(1), IGB(2);
+
+    auto gbf = [=](Time t, const StateView & s) { return std::exp((mu - .5 * sigma * sigma) * t + sigma * s.getValue(W)); };
+    auto igbDrift = [=](Time, const StateView & s) { return mu * s.getValue(IGB); };
+    auto igbVol = [=](Time, const StateView & s) { return sigma * s.getValue(IGB); };
+
+    auto staticProcess = makeStaticProcess(
+            tv, 0,
+            derivedVariable(gbf, 1.0),
+            itoIntegralProcess(igbDrift, igbVol, 1.0));
+    static_assert(decltype(staticProcess)::StateSize == 3);
+
+    WienerProcess dynamicProcess(tv, 0);
+    assert(dynamicProcess.addDerivedStateVariable(gbf, 1.0).index == GB.index);
+    assert(dynamicProcess.addItoIntegralProcess(igbDrift, igbVol, 1.0).index == IGB.index);
+
+    // both processes must produce the same paths from the same random numbers
+    std::default_random_engine staticRng(7), dynamicRng(7);
+    auto staticPath = staticProcess.generatePath(staticRng);
+    auto dynamicPath = dynamicProcess.generatePath(dynamicRng);
+    auto staticBlock = staticProcess.generatePaths(staticRng, 3);
+    auto dynamicBlock = dynamicProcess.generatePaths(dynamicRng, 3);
+    for (int it = 0; it < numTimes; ++it) {
+        for (StateVariable x : {W, GB, IGB}) {
+            assert(staticPath->getStateAtIndex(it).getValue(x) == dynamicPath->getStateAtIndex(it).getValue(x));
+            for (int ip = 0; ip < 3; ++ip)
+                assert(staticBlock->getValue(ip, it, x) == dynamicBlock->getValue(ip, it, x));
+        }
+    }
 }
 
 
@@ -137,6 +430,47 @@ void testTime() {
 }
 
 
+void testTimeGrid() {
+    using namespace irm;
+    info("testTimeGrid");
+
+    // uniform grids store no array but behave like their time vector
+    auto uniformVector = ITimeVector::createUniform(0, .25, 5);
+    auto uniformGrid = ITimeGrid::freeze(uniformVector);
+    assert(uniformGrid->isUniform());
+    assert(dynamic_cast<const UniformTimeGrid *>(uniformGrid.get()));
+    assert(ITimeGrid::freeze(uniformGrid) == uniformGrid);
+    for (int it = 0; it < 5; ++it)
+        assert(uniformGrid->getTimeAtIndex(it) == uniformVector->getTimeAtIndex(it));
+    assert(uniformGrid->getDtAtIndex(3) == .25);
+    assert(uniformGrid->getSqrtDtAtIndex(3) == .5);
+
+    // freezing copies, so later changes to the time vector are not seen
+    uniformVector->setTimeAtIndex(4, 10);
+    assert(uniformGrid->getTimeAtIndex(4) == 1);
+
+    auto nonUniformGrid = ITimeGrid::freeze(ITimeVector::createFromVector({0, .01, .05, 1}));
+    assert(!nonUniformGrid->isUniform());
+    assert(nonUniformGrid->getNumTimes() == 4);
+    assert(nonUniformGrid->getTimeAtIndex(2) == .05);
+    assert(nonUniformGrid->getDtAtIndex(3) == 1 - .05);
+    assert(nonUniformGrid->getSqrtDtAtIndex(3) == std::sqrt(1 - .05));
+    assert(visitTimeGrid(*nonUniformGrid, [](const auto & grid) { return grid.getDtAtIndex(1); }) == .01);
+
+    bool threw = false;
+    try { std::const_pointer_cast<ITimeGrid>(nonUniformGrid)->setTimeAtIndex(0, 1); } catch (const std::logic_error &) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { ITimeGrid::createFromVector({0, 1, .5}); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    // processes work on the frozen grid
+    WienerProcess process(uniformVector, 0);
+    assert(process.getTimeGrid()->getTimeAtIndex(4) == 10);
+    assert(!process.getTimeGrid()->isUniform());
+}
+
+
 void testWienerProcess() {
     info("testWienerProcess");
     using namespace irm;
@@ -181,4 +515,1195 @@ void testWienerProcess() {
 
     assert(std::abs(f3Val) < 1e-2);
 
-} // end function testWienerProcess
\ No newline at end of file
+} // end function testWienerProcess
+
+
+void testSimulate() {
+    info("testSimulate");
+    using namespace irm;
+    const int numTimes = 1000;
+    WienerProcess process(ITimeVector::createUniform(0, 1e-3, numTimes), 0);
+    StateVariable W(0);
+    StateVariable X = process.addItoIntegralProcess(
+            [](Time, const StateView &) { return 1; },
+            [&](Time, const StateView & s) { return 1 + s.getValue(W); },
+            0);
+    StateVariable Y = process.addDerivedStateVariable(
+            [&](Time t, const StateView & s) { return s.getValue(X) - t; },
+            0);
+    // an Ito process without drift nor volatility keeps its initial value
+    StateVariable C = process.addItoIntegralProcess(nullptr, nullptr, 3);
+
+    // visiting the streamed states must see exactly the states of the generated path
+    PhiloxEngine pathRng(17), simulateRng(17);
+    auto path = process.generatePath(pathRng);
+    int numVisited = 0;
+    double maxY = -1e100;
+    process.simulate(simulateRng, [&](int it, Time t, const StateView & state) {
+        assert(it == numVisited++);
+        assert(t == path->getTimeAtIndex(it));
+        for (StateVariable x : {W, X, Y, C})
+            assert(state.getValue(x) == path->getStateAtIndex(it).getValue(x));
+        assert(state.getValue(C) == 3);
+        maxY = std::max(maxY, state.getValue(Y));
+    });
+    assert(numVisited == numTimes);
+
+    double expectedMaxY = -1e100;
+    for (int it = 0; it < numTimes; ++it)
+        expectedMaxY = std::max(expectedMaxY, path->getStateAtIndex(it).getValue(Y));
+    assert(maxY == expectedMaxY);
+}
+
+
+void testObservationIndices() {
+    info("testObservationIndices");
+    using namespace irm;
+    const int numTimes = 101;
+    auto tv = ITimeVector::createUniform(0, .01, numTimes);
+    auto process = std::make_shared<WienerProcess>(tv, 0);
+    StateVariable W(0);
+    StateVariable X = process->addItoIntegralProcess(
+            [&](Time, const StateView & s) { return s.getValue(W); },
+            [](Time, const StateView &) { return .5; },
+            1);
+
+    std::vector<int> observationIndices = findTimeIndices(*tv, {0, .25, .5, 1});
+    assert((observationIndices == std::vector<int>{0, 25, 50, 100}));
+    bool threw = false;
+    try { findTimeIndices(*tv, {.255}); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { process->getObservationTimeVector({3, 3}); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    // observed paths hold the states of the full paths at the observation indices
+    const int numPaths = 70;
+    PhiloxEngine fullRng(5), observedRng(5), blockRng(5);
+    auto block = process->generatePaths(blockRng, numPaths, observationIndices);
+    auto engineBlock = MonteCarloEngine(process, numPaths, 5, 3).generatePaths(observationIndices);
+    assert(block->getNumTimes() == static_cast<int>(observationIndices.size()));
+    for (int ip = 0; ip < numPaths; ++ip) {
+        auto full = process->generatePath(fullRng);
+        auto observed = process->generatePath(observedRng, observationIndices);
+        auto engineRng = MonteCarloEngine::createPathGenerator(5, ip);
+        auto engineFull = process->generatePath(engineRng);
+        assert(observed->getNumTimes() == static_cast<int>(observationIndices.size()));
+        for (size_t iobs = 0; iobs < observationIndices.size(); ++iobs) {
+            int it = observationIndices[iobs];
+            assert(observed->getTimeAtIndex(iobs) == tv->getTimeAtIndex(it));
+            for (StateVariable x : {W, X}) {
+                double expected = full->getStateAtIndex(it).getValue(x);
+                assert(observed->getStateAtIndex(iobs).getValue(x) == expected);
+                assert(block->getValue(ip, iobs, x) == expected);
+                assert(engineBlock->getValue(ip, iobs, x) == engineFull->getStateAtIndex(it).getValue(x));
+            }
+        }
+    }
+
+    // blocks observed before the end of the time vector still draw all the normals of each path
+    std::vector<int> earlyIndices{10, 30};
+    PhiloxEngine earlyRng(6), earlyFullRng(6);
+    auto earlyBlock = process->generatePaths(earlyRng, 3, earlyIndices);
+    for (int ip = 0; ip < 3; ++ip) {
+        auto full = process->generatePath(earlyFullRng);
+        for (int iobs = 0; iobs < 2; ++iobs)
+            for (StateVariable x : {W, X})
+                assert(earlyBlock->getValue(ip, iobs, x) == full->getStateAtIndex(earlyIndices[iobs]).getValue(x));
+    }
+    assert(process->generatePath(earlyRng)->getStateAtIndex(numTimes - 1).getValue(X)
+           == process->generatePath(earlyFullRng)->getStateAtIndex(numTimes - 1).getValue(X));
+}
+
+
+void testDependencies() {
+    info("testDependencies");
+    using namespace irm;
+    const int numTimes = 20;
+    WienerProcess process(ITimeVector::createUniform(0, .05, numTimes), 0);
+    StateVariable W(0);
+    auto constant = [](double c) { return [c](Time, const StateView &) { return c; }; };
+    auto scaled = [](StateVariable x, double c) { return [x, c](Time, const StateView & s) { return c * s.getValue(x); }; };
+
+    StateVariable X = process.addItoIntegralProcess(scaled(W, -1), constant(.3), 1, {W});
+    StateVariable Y(2);
+    assert(process.addItoIntegralProcess(scaled(Y, .5), scaled(Y, .2), 2, {Y}).index == Y.index);
+    StateVariable Z = process.addItoIntegralProcess(constant(1), scaled(Y, .1), 3, {Y});
+    StateVariable A = process.addDerivedStateVariable(scaled(X, 2), 0, {X});
+    StateVariable B = process.addDerivedStateVariable(scaled(Z, 3), 0, {Z});
+    StateVariable C = process.addDerivedStateVariable(
+            [=](Time, const StateView & s) { return s.getValue(A) + s.getValue(B); }, 0, {A, B});
+    StateVariable Diagnostic = process.addDerivedStateVariable(scaled(C, 10), -1);
+    const std::vector<StateVariable> all{W, X, Y, Z, A, B, C, Diagnostic};
+
+    bool threw = false;
+    try { process.addDerivedStateVariable(constant(0), 0, {StateVariable(100)}); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    PhiloxEngine fullRng(9);
+    auto full = process.generatePaths(fullRng, 8);
+
+    // only C is wanted: the diagnostic variable, which nothing depends on, is not computed
+    process.setOutputVariables({C});
+    for (StateVariable x : all)
+        assert(process.isComputed(x) == (x.index != Diagnostic.index));
+    // only A is wanted: it only depends on X, which only depends on W
+    process.setOutputVariables({A});
+    for (StateVariable x : all)
+        assert(process.isComputed(x) == (x.index == W.index || x.index == X.index || x.index == A.index));
+
+    PhiloxEngine pathRng(9), blockRng(9), simulateRng(9);
+    auto path = process.generatePath(pathRng);
+    auto block = process.generatePaths(blockRng, 8);
+    int numVisited = 0;
+    process.simulate(simulateRng, [&](int it, Time, const StateView & state) {
+        ++numVisited;
+        assert(state.getValue(A) == path->getStateAtIndex(it).getValue(A));
+        assert(state.getValue(Diagnostic) == -1);
+    });
+    assert(numVisited == numTimes);
+    for (int it = 0; it < numTimes; ++it) {
+        for (StateVariable x : all) {
+            if (process.isComputed(x))
+                assert(path->getStateAtIndex(it).getValue(x) == full->getValue(0, it, x));
+            else
+                assert(path->getStateAtIndex(it).getValue(x) == full->getValue(0, 0, x));
+            for (int ip = 0; ip < 8; ++ip)
+                if (process.isComputed(x))
+                    assert(block->getValue(ip, it, x) == full->getValue(ip, it, x));
+                else
+                    assert(block->getValue(ip, it, x) == full->getValue(ip, 0, x));
+        }
+    }
+
+    // evaluating the independent variables of a level concurrently does not change the paths
+    process.setOutputVariables({});
+    const int numPaths = 6000;
+    PhiloxEngine sequentialRng(10), concurrentRng(10);
+    auto sequential = process.generatePaths(sequentialRng, numPaths);
+    process.setNumEvaluationThreads(3);
+    auto concurrent = process.generatePaths(concurrentRng, numPaths);
+    for (int it = 0; it < numTimes; ++it)
+        for (StateVariable x : all)
+            for (int ip = 0; ip < numPaths; ++ip)
+                assert(sequential->getValue(ip, it, x) == concurrent->getValue(ip, it, x));
+    // nor do observed blocks, whose threads are shared by all the steps
+    auto observed = process.generatePaths(concurrentRng, numPaths, {numTimes / 2, numTimes - 1});
+    auto expected = process.generatePaths(sequentialRng, numPaths);
+    for (int iobs = 0; iobs < 2; ++iobs)
+        for (StateVariable x : all)
+            for (int ip = 0; ip < numPaths; ++ip)
+                assert(observed->getValue(ip, iobs, x) == expected->getValue(ip, iobs == 0 ? numTimes / 2 : numTimes - 1, x));
+}
+
+
+void testExpression() {
+    info("testExpression");
+    using namespace irm;
+    using namespace irm::expr;
+    StateVariable W(0), Y(1), Z(2);
+
+    // scalar evaluation on a strided state
+    double values[] = {2, -1, 4, -1, 9, -1};
+    StateView state(values, 3, 2);
+    assert((X(W) * 3 + 1)(0, state) == 7);
+    assert((X(Y) / X(W) - t)(1, state) == 1);
+    assert(doubleEquals(sqrt(X(Z))(0, state), 3, 1e-15));
+    assert((max(X(W), X(Y)) + min(-X(W), 0.))(0, state) == 2);
+    assert(doubleEquals(exp(log(X(Y)))(0, state), 4, 1e-14));
+    auto variables = (X(W) * t + abs(X(Z)) * X(W)).getVariables();
+    assert(variables.size() == 3 && variables[0].index == W.index && variables[1].index == Z.index);
+
+    // processes defined by expressions match the same processes defined by lambdas, bit for bit
+    const int numTimes = 25;
+    const int numPaths = 40;
+    auto timeVector = ITimeVector::createUniform(0, .04, numTimes);
+    const double mu = .05, sigma = .2;
+    WienerProcess lambdas(timeVector, 0);
+    lambdas.addItoIntegralProcess(
+            [=](Time, const StateView & s) { return mu * s.getValue(Y); },
+            [=](Time, const StateView & s) { return sigma * s.getValue(Y); },
+            1);
+    lambdas.addDerivedStateVariable(
+            [=](Time t, const StateView & s) { return std::exp(-mu * t) * s.getValue(Y) + s.getValue(W); },
+            0);
+    WienerProcess expressions(timeVector, 0);
+    assert(expressions.getNextStateVariable().index == Y.index);
+    expressions.addItoIntegralProcess(mu * X(Y), sigma * X(Y), 1);
+    expressions.addDerivedStateVariable(exp(-mu * t) * X(Y) + X(W), 0);
+
+    PhiloxEngine lambdaRng(12), expressionRng(12), pathRng(12);
+    auto expected = lambdas.generatePaths(lambdaRng, numPaths);
+    auto actual = expressions.generatePaths(expressionRng, numPaths);
+    auto path = expressions.generatePath(pathRng);
+    for (int it = 0; it < numTimes; ++it) {
+        for (int x = 0; x < 3; ++x) {
+            for (int ip = 0; ip < numPaths; ++ip)
+                assert(actual->getValue(ip, it, StateVariable(x)) == expected->getValue(ip, it, StateVariable(x)));
+            assert(path->getStateAtIndex(it).getValue(StateVariable(x)) == expected->getValue(0, it, StateVariable(x)));
+        }
+    }
+
+    // dependencies are read off the expressions
+    expressions.addDerivedStateVariable(X(W) * 2, 0);
+    expressions.setOutputVariables({StateVariable(3)});
+    assert(expressions.isComputed(W) && !expressions.isComputed(Y) && !expressions.isComputed(Z));
+}
+
+
+void testSobol() {
+    info("testSobol");
+    using namespace irm;
+
+    // the first two dimensions do not depend on the choice of initial direction numbers
+    SobolSequence sequence(2);
+    const double expected[][2] = {{.5, .5}, {.75, .25}, {.25, .75}, {.375, .375}, {.875, .875}, {.625, .125}, {.125, .625}};
+    double point[2];
+    for (const auto & e : expected) {
+        sequence.nextUniforms(point);
+        assert(point[0] == e[0] && point[1] == e[1]);
+    }
+
+    // every coordinate of the first 2^m - 1 points, with the origin, hits each interval [k / 2^m, (k+1) / 2^m) once
+    const int dimension = 1000, m = 10, numPoints = (1 << m) - 1;
+    SobolSequence highDimensional(dimension);
+    std::vector<double> points(static_cast<size_t>(numPoints) * dimension);
+    for (int i = 0; i < numPoints; ++i)
+        highDimensional.nextUniforms(points.data() + static_cast<size_t>(i) * dimension);
+    for (int j = 0; j < dimension; ++j) {
+        std::vector<bool> hit(numPoints + 1, false);
+        hit[0] = true;
+        for (int i = 0; i < numPoints; ++i) {
+            double u = points[static_cast<size_t>(i) * dimension + j];
+            assert(u > 0 && u < 1);
+            int k = static_cast<int>(u * (numPoints + 1));
+            assert(!hit[k]);
+            hit[k] = true;
+        }
+    }
+
+    // skipping ahead lands on the same points
+    SobolSequence skipped(dimension);
+    skipped.skipTo(700);
+    assert(skipped.getIndex() == 700);
+    std::vector<double> skippedPoint(dimension);
+    skipped.nextUniforms(skippedPoint.data());
+    for (int j = 0; j < dimension; ++j)
+        assert(skippedPoint[j] == points[static_cast<size_t>(699) * dimension + j]);
+
+    // direction numbers read in the Joe & Kuo format
+    std::istringstream joeKuo(
+            "d       s       a       m_i\n"
+            "2       1       0       1\n"
+            "3       2       1       1 3\n"
+            "4       3       1       1 3 1\n");
+    SobolSequence fromFile = SobolSequence::createFromJoeKuo(4, joeKuo);
+    double fileFirst[4], fileSecond[4];
+    fromFile.nextUniforms(fileFirst);
+    fromFile.nextUniforms(fileSecond);
+    for (int j = 0; j < 4; ++j)
+        assert(fileFirst[j] == .5);
+    assert(fileSecond[0] == .75 && fileSecond[1] == .25 && fileSecond[2] == .25 && fileSecond[3] == .25);
+    bool threw = false;
+    std::istringstream tooShort("d s a m_i\n2 1 0 1\n");
+    try { SobolSequence::createFromJoeKuo(4, tooShort); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    // paths from caller supplied normals, one point per path
+    const int numTimes = 33, numPaths = 64;
+    WienerProcess process(ITimeVector::createUniform(0, 1. / 32, numTimes), 0);
+    StateVariable W(0);
+    int numSamples = process.getRequiredNumberOfSamples();
+    assert(numSamples == numTimes - 1);
+    SobolSequence pathSequence(numSamples);
+    std::vector<double> normals(static_cast<size_t>(numSamples) * numPaths);
+    pathSequence.fillNormals(normals.data(), numPaths);
+    auto block = process.generatePathsFromNormals(normals, numPaths);
+    double meanTerminal = 0;
+    for (int ip = 0; ip < numPaths; ++ip) {
+        std::vector<double> pathNormals(normals.begin() + ip * numSamples, normals.begin() + (ip + 1) * numSamples);
+        auto path = process.generatePathFromNormals(pathNormals);
+        for (int it = 0; it < numTimes; ++it)
+            assert(path->getStateAtIndex(it).getValue(W) == block->getValue(ip, it, W));
+        meanTerminal += block->getValue(ip, numTimes - 1, W) / numPaths;
+    }
+    // the first dimension is perfectly stratified, the terminal value only has a small sampling error
+    assert(std::abs(meanTerminal) < .05);
+
+    threw = false;
+    try { process.generatePathFromNormals(std::vector<double>(numSamples + 1)); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    // same normals, same paths as from a random number generator
+    PhiloxEngine rng(3), normalsRng(3);
+    std::vector<double> rngNormals(numSamples);
+    NormalSampler::fill(normalsRng, rngNormals.data(), numSamples);
+    auto rngPath = process.generatePath(rng);
+    auto normalsPath = process.generatePathFromNormals(rngNormals);
+    for (int it = 0; it < numTimes; ++it)
+        assert(rngPath->getStateAtIndex(it).getValue(W) == normalsPath->getStateAtIndex(it).getValue(W));
+}
+
+
+void testBrownianBridge() {
+    info("testBrownianBridge");
+    using namespace irm;
+
+    // the bridge is a linear map L of the normals with L L' = min(t_i, t_j), for any number of steps
+    for (int numSteps = 0; numSteps < 20; ++numSteps) {
+        std::vector<Time> times{.5};
+        for (int i = 0; i < numSteps; ++i)
+            times.push_back(times.back() + .1 * (1 + i % 3));
+        BrownianBridge bridge(*ITimeVector::createFromVector(times));
+        assert(bridge.getNumSteps() == numSteps);
+        std::vector<double> loadings(numSteps * numSteps), unit(numSteps, 0.0);
+        for (int k = 0; k < numSteps; ++k) {
+            unit[k] = 1;
+            bridge.buildPath(unit.data(), loadings.data() + k * numSteps);
+            unit[k] = 0;
+        }
+        for (int i = 0; i < numSteps; ++i) {
+            for (int j = 0; j < numSteps; ++j) {
+                double covariance = 0;
+                for (int k = 0; k < numSteps; ++k)
+                    covariance += loadings[k * numSteps + i] * loadings[k * numSteps + j];
+                assert(doubleEquals(covariance, std::min(times[i + 1], times[j + 1]) - times[0], 1e-12));
+            }
+        }
+    }
+
+    // increments add up to the path, the first normal alone setting the terminal value
+    const int numTimes = 17;
+    auto timeVector = ITimeVector::createUniform(0, .25, numTimes);
+    BrownianBridge bridge(*timeVector);
+    std::vector<double> normals(numTimes - 1), path(numTimes - 1), increments(numTimes - 1);
+    PhiloxEngine normalsRng(4);
+    NormalSampler::fill(normalsRng, normals.data(), normals.size());
+    bridge.buildPath(normals.data(), path.data());
+    bridge.buildIncrements(normals.data(), increments.data());
+    assert(doubleEquals(path.back(), 2 * normals[0], 1e-15));
+    double w = 0;
+    for (int i = 0; i < numTimes - 1; ++i) {
+        w += increments[i];
+        assert(doubleEquals(w, path[i], 1e-14));
+    }
+
+    // the wiener process built by bridge, the other variables being computed from its increments as usual
+    WienerProcess process(timeVector, 1);
+    StateVariable W(0);
+    StateVariable S = process.addItoIntegralProcess(
+            [](Time, const StateView & s) { return .1 * s.getValue(StateVariable(1)); },
+            [](Time, const StateView & s) { return .3 * s.getValue(StateVariable(1)); },
+            1);
+    assert(process.getPathConstruction() == WienerProcess::PathConstruction::Incremental);
+    process.setPathConstruction(WienerProcess::PathConstruction::BrownianBridge);
+    assert(process.getPathConstruction() == WienerProcess::PathConstruction::BrownianBridge);
+    auto bridgedPath = process.generatePathFromNormals(normals);
+    double bridgedW = 1;
+    for (int it = 1; it < numTimes; ++it) {
+        // the bridged increments are used as they are
+        bridgedW += increments[it - 1];
+        assert(bridgedPath->getStateAtIndex(it).getValue(W) == bridgedW);
+        assert(doubleEquals(bridgedPath->getStateAtIndex(it).getValue(W), 1 + path[it - 1], 1e-13));
+        double s0 = bridgedPath->getStateAtIndex(it - 1).getValue(S);
+        double dW = bridgedPath->getStateAtIndex(it).getValue(W) - bridgedPath->getStateAtIndex(it - 1).getValue(W);
+        assert(doubleEquals(bridgedPath->getStateAtIndex(it).getValue(S), s0 + .25 * .1 * s0 + dW * .3 * s0, 1e-13));
+    }
+
+    // also on uneven steps, including one of zero length
+    auto unevenTimes = ITimeVector::createFromVector({0, .3, .3, .7, 1.1, 1.9});
+    BrownianBridge unevenBridge(*unevenTimes);
+    WienerProcess unevenProcess(unevenTimes, 0);
+    unevenProcess.setPathConstruction(WienerProcess::PathConstruction::BrownianBridge);
+    std::vector<double> unevenNormals{.7, -1.3, .4, 2.1, -.2}, unevenIncrements(5);
+    unevenBridge.buildIncrements(unevenNormals.data(), unevenIncrements.data());
+    auto unevenPath = unevenProcess.generatePathFromNormals(unevenNormals);
+    bridgedW = 0;
+    for (int it = 1; it < 6; ++it) {
+        bridgedW += unevenIncrements[it - 1];
+        assert(unevenPath->getStateAtIndex(it).getValue(W) == bridgedW);
+    }
+    assert(unevenPath->getStateAtIndex(2).getValue(W) == unevenPath->getStateAtIndex(1).getValue(W));
+
+    // every generation mode agrees
+    const int numPaths = 70;
+    auto process2 = std::make_shared<WienerProcess>(process);
+    MonteCarloEngine engine(process2, numPaths, 8, 2);
+    auto engineBlock = engine.generatePaths();
+    auto rng = MonteCarloEngine::createPathGenerator(8, 0);
+    auto blockRng = MonteCarloEngine::createPathGenerator(8, 0), simulateRng = MonteCarloEngine::createPathGenerator(8, 0);
+    auto firstPath = process.generatePath(rng);
+    auto block = process.generatePaths(blockRng, 1);
+    int numVisited = 0;
+    process.simulate(simulateRng, [&](int it, Time, const StateView & state) {
+        ++numVisited;
+        for (StateVariable x : {W, S}) {
+            assert(state.getValue(x) == firstPath->getStateAtIndex(it).getValue(x));
+            assert(block->getValue(0, it, x) == firstPath->getStateAtIndex(it).getValue(x));
+            assert(engineBlock->getValue(0, it, x) == firstPath->getStateAtIndex(it).getValue(x));
+        }
+    });
+    assert(numVisited == numTimes);
+}
+
+
+void testAntitheticPaths() {
+    info("testAntitheticPaths");
+    using namespace irm;
+    const int numTimes = 21;
+    const int numPairs = 500;
+    const double sigma = .2;
+    WienerProcess process(ITimeVector::createUniform(0, .05, numTimes), 0);
+    StateVariable W(0);
+    StateVariable S = process.addItoIntegralProcess(
+            [](Time, const StateView &) { return 0.0; },
+            [=](Time, const StateView & s) { return sigma * s.getValue(StateVariable(1)); },
+            1);
+
+    for (auto construction : {WienerProcess::PathConstruction::Incremental, WienerProcess::PathConstruction::BrownianBridge}) {
+        process.setPathConstruction(construction);
+        PhiloxEngine pairRng(5), pathRng(5);
+        auto pairs = process.generateAntitheticPaths(pairRng, numPairs);
+        assert(pairs->getNumPaths() == 2 * numPairs);
+        double mean = 0, pairMeanSquares = 0, pathMeanSquares = 0;
+        for (int ipair = 0; ipair < numPairs; ++ipair) {
+            // the first path of the pair is the plain path, the second its mirror
+            auto path = process.generatePath(pathRng);
+            for (int it = 0; it < numTimes; ++it) {
+                assert(pairs->getValue(2 * ipair, it, W) == path->getStateAtIndex(it).getValue(W));
+                assert(pairs->getValue(2 * ipair, it, S) == path->getStateAtIndex(it).getValue(S));
+                assert(doubleEquals(pairs->getValue(2 * ipair + 1, it, W), -pairs->getValue(2 * ipair, it, W), 1e-14));
+            }
+            double s0 = pairs->getValue(2 * ipair, numTimes - 1, S), s1 = pairs->getValue(2 * ipair + 1, numTimes - 1, S);
+            mean += (s0 + s1) / 2 / numPairs;
+            pairMeanSquares += (s0 + s1) * (s0 + s1) / 4 / numPairs;
+            pathMeanSquares += s0 * s0 / numPairs;
+        }
+        // averaging the pairs of this monotone payoff removes most of the variance
+        assert(std::abs(mean - 1) < .01);
+        assert(pairMeanSquares - mean * mean < .1 * (pathMeanSquares - mean * mean));
+    }
+}
+
+
+void testMultiFactor() {
+    info("testMultiFactor");
+    using namespace irm;
+    const int numTimes = 11;
+    const double dt = .1;
+    const std::vector<std::vector<double>> correlation{
+            {1, .5, -.3},
+            {.5, 1, .2},
+            {-.3, .2, 1}};
+    WienerProcess process(ITimeVector::createUniform(0, dt, numTimes), {0, 1, 2}, correlation);
+    assert(process.getNumFactors() == 3);
+    assert(process.getRequiredNumberOfSamples() == 3 * (numTimes - 1));
+    StateVariable W0(0), W1(1), W2(2);
+    StateVariable X = process.addItoIntegralProcess(
+            [](Time, const StateView &) { return .1; },
+            std::vector<WienerProcess::FactorLoading>{
+                    {0, [](Time, const StateView &) { return .4; }},
+                    {2, [](Time, const StateView &) { return -.2; }}},
+            5);
+    StateVariable Y = process.addItoIntegralProcess(
+            [](Time, const StateView &) { return 0.0; },
+            std::vector<WienerProcess::FactorLoading>{{1, [](Time, const StateView &) { return 1.0; }}},
+            0, {});
+    const std::vector<StateVariable> all{W0, W1, W2, X, Y};
+
+    bool threw = false;
+    try { process.addItoIntegralProcess(WienerProcess::StateFunction(), {{3, [](Time, const StateView &) { return 1.0; }}}, 0); }
+    catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+    for (const auto & invalid : {
+            std::vector<std::vector<double>>{{1, .5}, {.4, 1}},
+            std::vector<std::vector<double>>{{1, .5}, {.5, .9}},
+            std::vector<std::vector<double>>{{1, .9, -.9}, {.9, 1, .9}, {-.9, .9, 1}}}) {
+        threw = false;
+        try { WienerProcess(ITimeVector::createUniform(0, dt, numTimes), std::vector<double>(invalid.size(), 0.0), invalid); }
+        catch (const std::invalid_argument &) { threw = true; }
+        assert(threw);
+    }
+
+    // the loadings add up the factor increments, every generation mode agreeing
+    for (auto construction : {WienerProcess::PathConstruction::Incremental, WienerProcess::PathConstruction::BrownianBridge}) {
+        process.setPathConstruction(construction);
+        const int numPaths = 100;
+        MonteCarloEngine engine(std::make_shared<WienerProcess>(process), numPaths, 21, 2);
+        auto engineBlock = engine.generatePaths();
+        auto pathRng = MonteCarloEngine::createPathGenerator(21, 1);
+        auto blockRng = MonteCarloEngine::createPathGenerator(21, 1), simulateRng = MonteCarloEngine::createPathGenerator(21, 1);
+        auto path = process.generatePath(pathRng);
+        auto block = process.generatePaths(blockRng, 1);
+        process.simulate(simulateRng, [&](int it, Time t, const StateView & state) {
+            for (StateVariable x : all) {
+                assert(state.getValue(x) == path->getStateAtIndex(it).getValue(x));
+                assert(block->getValue(0, it, x) == path->getStateAtIndex(it).getValue(x));
+                assert(engineBlock->getValue(1, it, x) == path->getStateAtIndex(it).getValue(x));
+            }
+            double expectedX = 5 + .1 * t + .4 * state.getValue(W0) - .2 * (state.getValue(W2) - 2);
+            assert(doubleEquals(state.getValue(X), expectedX, 1e-12));
+            assert(doubleEquals(state.getValue(Y), state.getValue(W1) - 1, 1e-12));
+        });
+    }
+
+    // the increments have the requested correlation
+    process.setPathConstruction(WienerProcess::PathConstruction::Incremental);
+    const int numPaths = 20000;
+    PhiloxEngine rng(22);
+    auto block = process.generatePaths(rng, numPaths);
+    for (int f = 0; f < 3; ++f) {
+        for (int g = 0; g < 3; ++g) {
+            double covariance = 0;
+            for (int ip = 0; ip < numPaths; ++ip)
+                covariance += (block->getValue(ip, 1, StateVariable(f)) - f) * (block->getValue(ip, 1, StateVariable(g)) - g);
+            covariance /= numPaths * dt;
+            assert(std::abs(covariance - correlation[f][g]) < .05);
+        }
+    }
+
+    // perfectly correlated factors are accepted
+    WienerProcess degenerate(ITimeVector::createUniform(0, dt, numTimes), {0, 0}, {{1, 1}, {1, 1}});
+    PhiloxEngine degenerateRng(23);
+    auto degeneratePath = degenerate.generatePath(degenerateRng);
+    for (int it = 0; it < numTimes; ++it)
+        assert(doubleEquals(degeneratePath->getStateAtIndex(it).getValue(W0), degeneratePath->getStateAtIndex(it).getValue(W1), 1e-15));
+}
+
+
+void testItoSchemes() {
+    info("testItoSchemes");
+    using namespace irm;
+    const int numTimes = 5;
+    const double T = 2, mu = .05, sigma = .4, s0 = 100;
+    WienerProcess process(ITimeVector::createUniform(0, T / (numTimes - 1), numTimes), 0);
+    StateVariable W(0);
+    auto gbmDrift = [=](StateVariable x) { return [=](Time, const StateView & s) { return mu * s.getValue(x); }; };
+    auto gbmVol = [=](StateVariable x) { return [=](Time, const StateView & s) { return sigma * s.getValue(x); }; };
+
+    StateVariable exact = process.addGeometricBrownianMotion(mu, sigma, s0);
+    StateVariable euler = process.getNextStateVariable();
+    process.addItoIntegralProcess(gbmDrift(euler), gbmVol(euler), s0);
+    StateVariable milstein = process.getNextStateVariable();
+    process.addItoIntegralProcess(gbmDrift(milstein), gbmVol(milstein), s0);
+    process.setItoScheme(milstein, WienerProcess::ItoScheme::Milstein, [=](Time, const StateView &) { return sigma; });
+    StateVariable numericalMilstein = process.getNextStateVariable();
+    process.addItoIntegralProcess(gbmDrift(numericalMilstein), gbmVol(numericalMilstein), s0);
+    process.setItoScheme(numericalMilstein, WienerProcess::ItoScheme::Milstein);
+    StateVariable logEuler = process.getNextStateVariable();
+    process.addItoIntegralProcess(gbmDrift(logEuler), gbmVol(logEuler), s0);
+    process.setItoScheme(logEuler, WienerProcess::ItoScheme::LogEuler);
+    StateVariable batchLogEuler = process.getNextStateVariable();
+    process.addItoIntegralProcess(mu * expr::X(batchLogEuler), sigma * expr::X(batchLogEuler), s0);
+    process.setItoScheme(batchLogEuler, WienerProcess::ItoScheme::LogEuler);
+    const double kappa = 1.5, theta = .03, ouSigma = .02, r0 = .1;
+    StateVariable ou = process.addOrnsteinUhlenbeckProcess(kappa, theta, ouSigma, r0);
+
+    bool threw = false;
+    StateVariable derived = process.addDerivedStateVariable([](Time, const StateView &) { return 0.0; }, 0);
+    try { process.setItoScheme(derived, WienerProcess::ItoScheme::Milstein); } catch (const std::invalid_argument &) { threw = true; }
+    assert(threw);
+
+    const int numPaths = 20000;
+    PhiloxEngine rng(31);
+    auto block = process.generatePaths(rng, numPaths);
+    double eulerError = 0, milsteinError = 0, ouMean = 0, ouMeanSquares = 0;
+    for (int ip = 0; ip < numPaths; ++ip) {
+        for (int it = 0; it < numTimes; ++it) {
+            double t = T * it / (numTimes - 1);
+            double closedForm = s0 * std::exp((mu - .5 * sigma * sigma) * t + sigma * block->getValue(ip, it, W));
+            assert(doubleEquals(block->getValue(ip, it, exact), closedForm, 1e-10));
+            assert(doubleEquals(block->getValue(ip, it, logEuler), closedForm, 1e-10));
+            assert(block->getValue(ip, it, batchLogEuler) == block->getValue(ip, it, logEuler));
+            assert(doubleEquals(block->getValue(ip, it, numericalMilstein), block->getValue(ip, it, milstein), 1e-5));
+        }
+        double terminal = block->getValue(ip, numTimes - 1, exact);
+        eulerError += std::abs(block->getValue(ip, numTimes - 1, euler) - terminal) / numPaths;
+        milsteinError += std::abs(block->getValue(ip, numTimes - 1, milstein) - terminal) / numPaths;
+        double r = block->getValue(ip, numTimes - 1, ou);
+        ouMean += r / numPaths;
+        ouMeanSquares += r * r / numPaths;
+    }
+    // Milstein converges strongly at order 1, Euler at order 1/2
+    assert(milsteinError < .5 * eulerError);
+    // the exact transition has the right moments on a coarse grid
+    double expectedMean = theta + (r0 - theta) * std::exp(-kappa * T);
+    double expectedVariance = ouSigma * ouSigma * (1 - std::exp(-2 * kappa * T)) / (2 * kappa);
+    assert(std::abs(ouMean - expectedMean) < 3 * std::sqrt(expectedVariance / numPaths));
+    assert(std::abs(ouMeanSquares - ouMean * ouMean - expectedVariance) < .05 * expectedVariance);
+
+    // single paths and blocks agree
+    PhiloxEngine pathRng(31);
+    auto path = process.generatePath(pathRng);
+    for (int it = 0; it < numTimes; ++it)
+        for (StateVariable x : {exact, euler, milstein, numericalMilstein, logEuler, batchLogEuler, ou})
+            assert(path->getStateAtIndex(it).getValue(x) == block->getValue(0, it, x));
+}
+
+
+void testAdaptivePath() {
+    info("testAdaptivePath");
+    using namespace irm;
+    const int numTimes = 6;
+    const double T = 1;
+    auto timeVector = ITimeVector::createUniform(0, T / (numTimes - 1), numTimes);
+
+    // a stiff drift, relaxing fast towards cos(t): explicit steps of the time vector are unstable
+    const double lambda = 60;
+    WienerProcess stiff(timeVector, 0);
+    StateVariable X = stiff.addItoIntegralProcess(
+            [=](Time t, const StateView & s) { return -lambda * (s.getValue(StateVariable(1)) - std::cos(t)); },
+            WienerProcess::StateFunction(),
+            0);
+    auto solution = [=](Time t) {
+        double c = lambda * lambda / (lambda * lambda + 1);
+        return c * (std::cos(t) + std::sin(t) / lambda) - c * std::exp(-lambda * t);
+    };
+    PhiloxEngine fixedRng(41), adaptiveRng(41);
+    auto fixed = stiff.generatePath(fixedRng);
+    int numSteps = 0;
+    auto adaptive = stiff.generateAdaptivePath(adaptiveRng, 1e-4, 12, &numSteps);
+    double fixedError = 0, adaptiveError = 0;
+    for (int it = 1; it < numTimes; ++it) {
+        double t = timeVector->getTimeAtIndex(it);
+        fixedError = std::max(fixedError, std::abs(fixed->getStateAtIndex(it).getValue(X) - solution(t)));
+        adaptiveError = std::max(adaptiveError, std::abs(adaptive->getStateAtIndex(it).getValue(X) - solution(t)));
+    }
+    assert(fixedError > 1);
+    assert(adaptiveError < 1e-2);
+    // most of the refinement is spent in the initial layer:
+    // refining every step down to depth 12 would evaluate (numTimes - 1) * (2^13 - 1) steps
+    assert(numSteps > 3 * (numTimes - 1) && numSteps < (numTimes - 1) << 10);
+
+    // a drift acting on the first half of the step only: the second half is checked once from the refined midpoint,
+    // which costs a single step and its two halves on top of refining the first half as a step of its own
+    auto firstHalfOnly = [=](ITimeVectorCPtr halfTimeVector) {
+        auto process = std::make_shared<WienerProcess>(halfTimeVector, 0);
+        process->addItoIntegralProcess(
+                [=](Time t, const StateView & s) { return t <= .5 ? -lambda * (s.getValue(StateVariable(1)) - 1) : 0.0; },
+                WienerProcess::StateFunction(),
+                0);
+        return process;
+    };
+    PhiloxEngine wholeRng(43), halfRng(43);
+    int wholeSteps = 0, halfSteps = 0;
+    auto whole = firstHalfOnly(ITimeVector::createFromVector({0, 1}))->generateAdaptivePath(wholeRng, 1e-4, 8, &wholeSteps);
+    auto half = firstHalfOnly(ITimeVector::createFromVector({0, .5}))->generateAdaptivePath(halfRng, 1e-4, 7, &halfSteps);
+    assert(halfSteps > 3);
+    assert(wholeSteps == halfSteps + 5);
+    assert(whole->getStateAtIndex(1).getValue(X) == half->getStateAtIndex(1).getValue(X));
+
+    // refined Euler steps converge to the exact geometric brownian motion of the same wiener path
+    // (the step doubling estimate of a diffusion is itself random, so this needs a tight tolerance)
+    const double mu = .1, sigma = .5;
+    WienerProcess gbm(timeVector, 0);
+    StateVariable W(0);
+    StateVariable S = gbm.getNextStateVariable();
+    gbm.addItoIntegralProcess(mu * expr::X(S), sigma * expr::X(S), 1);
+    const int numPaths = 50;
+    double coarseError = 0, refinedError = 0;
+    for (int ip = 0; ip < numPaths; ++ip) {
+        // one stream per path, since refinement draws a varying number of normals
+        PhiloxEngine coarseRng(42, ip), refinedRng(42, ip);
+        auto coarse = gbm.generatePath(coarseRng);
+        auto refined = gbm.generateAdaptivePath(refinedRng, 1e-7);
+        for (int it = 0; it < numTimes; ++it) {
+            double w = coarse->getStateAtIndex(it).getValue(W);
+            assert(doubleEquals(refined->getStateAtIndex(it).getValue(W), w, 1e-12));
+            double exact = std::exp((mu - .5 * sigma * sigma) * timeVector->getTimeAtIndex(it) + sigma * w);
+            coarseError += std::abs(coarse->getStateAtIndex(it).getValue(S) - exact);
+            refinedError += std::abs(refined->getStateAtIndex(it).getValue(S) - exact);
+        }
+    }
+    assert(refinedError < .2 * coarseError);
+}
+
+
+void testMultilevelMonteCarlo() {
+    info("testMultilevelMonteCarlo");
+    using namespace irm;
+    const double T = 1, mu = .05, sigma = .2;
+    auto buildProcess = [=](ITimeVectorCPtr timeVector) {
+        auto process = std::make_shared<WienerProcess>(timeVector, 0);
+        StateVariable S = process->getNextStateVariable();
+        process->addItoIntegralProcess(mu * expr::X(S), sigma * expr::X(S), 1);
+        return process;
+    };
+    auto process = buildProcess(ITimeVector::createUniform(0, T, 2));
+    StateVariable S(1);
+    auto payoff = [=](const PathBlock & paths, int path) {
+        return paths.getValues(paths.getTimeVector()->getNumTimes() - 1, S)[path];
+    };
+    MultilevelMonteCarlo mlmc(process, payoff, 2, 7);
+
+    // level processes behave as processes built on the level grid
+    auto levelProcess = mlmc.getLevelProcess(2);
+    assert(levelProcess->getTimeGrid()->getNumTimes() == 9);
+    auto fresh = buildProcess(ITimeVector::createUniform(0, T / 8, 9));
+    PhiloxEngine levelRng(3), freshRng(3);
+    auto levelPath = levelProcess->generatePath(levelRng);
+    auto freshPath = fresh->generatePath(freshRng);
+    for (int it = 0; it < 9; ++it)
+        assert(levelPath->getStateAtIndex(it).getValue(S) == freshPath->getStateAtIndex(it).getValue(S));
+
+    // samples only depend on the level and path index
+    auto all = mlmc.sampleLevel(2, 0, 20);
+    auto some = mlmc.sampleLevel(2, 10, 5);
+    for (int ip = 0; ip < 5; ++ip)
+        assert(some[ip] == all[10 + ip]);
+
+    const double rmse = 2e-3;
+    auto result = mlmc.estimate(rmse);
+    int numLevels = result.numPaths.size();
+    assert(numLevels >= 3 && numLevels == static_cast<int>(result.variances.size()));
+    assert(std::abs(result.estimate - std::exp(mu * T)) < 3 * rmse);
+    assert(result.standardError < rmse);
+    // the coupled corrections get cheaper to estimate
+    assert(result.variances[numLevels - 1] < .5 * result.variances[1]);
+    assert(result.variances[1] < .01 * result.variances[0]);
+    assert(result.numPaths[numLevels - 1] < result.numPaths[0]);
+
+    // a single level is plain Monte Carlo on the coarsest grid, more levels being added as the bias needs
+    auto single = mlmc.estimate(.05, 1, 1, 100);
+    assert(single.numPaths.size() == 1 && single.estimate == single.means[0]);
+    auto grown = mlmc.estimate(.05, 1, 7, 100);
+    assert(grown.numPaths.size() >= 2);
+}
+
+
+void testPathStatistics() {
+    info("testPathStatistics");
+    using namespace irm;
+
+    std::vector<double> values{1, 4, 2, 8, 5, 7, 3, 6};
+    RunningStatistics one, left, right, batch;
+    for (double value : values)
+        one.add(value);
+    for (int i = 0; i < 3; ++i)
+        left.add(values[i]);
+    right.add(values.data() + 3, values.size() - 3);
+    left.merge(right);
+    batch.merge(RunningStatistics());
+    batch.add(values.data(), values.size());
+    for (const RunningStatistics & statistics : {one, left, batch}) {
+        assert(statistics.getCount() == 8);
+        assert(doubleEquals(statistics.getMean(), 4.5, 1e-14));
+        assert(doubleEquals(statistics.getVariance(), 6, 1e-13));
+        assert(doubleEquals(statistics.getStandardError(), std::sqrt(6.0 / 8), 1e-13));
+    }
+    auto interval = one.getConfidenceInterval(2);
+    assert(doubleEquals(interval.second - interval.first, 4 * one.getStandardError(), 1e-13));
+
+    // path by path, block by block and chunk by chunk on several threads agree
+    const int numTimes = 11;
+    const int numPaths = 1000;
+    const std::uint64_t seed = 11;
+    auto timeVector = ITimeVector::createUniform(0, .1, numTimes);
+    auto process = std::make_shared<WienerProcess>(timeVector, 0);
+    StateVariable W(0);
+    StateVariable X = process->getNextStateVariable();
+    process->addItoIntegralProcess(-expr::X(X), expr::Constant(.3), 1);
+    MonteCarloEngine engine(process, numPaths, seed, 4);
+    auto block = engine.generatePaths();
+    PathStatistics fromBlock(timeVector, 2), fromPaths(timeVector, 2), firstHalf(timeVector, 2), secondHalf(timeVector, 2);
+    fromBlock.addPaths(*block);
+    for (int ip = 0; ip < numPaths; ++ip) {
+        fromPaths.addPath(*block->getPath(ip));
+        (ip < numPaths / 2 ? firstHalf : secondHalf).addPath(*block->getPath(ip));
+    }
+    firstHalf.merge(secondHalf);
+    std::vector<int> allIndices(numTimes);
+    for (int it = 0; it < numTimes; ++it)
+        allIndices[it] = it;
+    PathStatistics streamed = engine.computeStatistics(allIndices);
+    // chunks are merged in path order, whatever the number of threads
+    PathStatistics singleThreaded = MonteCarloEngine(process, numPaths, seed, 1).computeStatistics(allIndices);
+    for (int it = 0; it < numTimes; ++it) {
+        for (StateVariable x : {W, X}) {
+            assert(streamed.getStatistics(it, x).getMean() == singleThreaded.getStatistics(it, x).getMean());
+            assert(streamed.getStatistics(it, x).getVariance() == singleThreaded.getStatistics(it, x).getVariance());
+        }
+    }
+    for (const PathStatistics * statistics : {&fromPaths, &firstHalf, &streamed}) {
+        assert(statistics->getNumPaths() == numPaths);
+        for (int it = 0; it < numTimes; ++it) {
+            for (StateVariable x : {W, X}) {
+                const RunningStatistics & expected = fromBlock.getStatistics(it, x);
+                const RunningStatistics & actual = statistics->getStatistics(it, x);
+                assert(actual.getCount() == numPaths);
+                assert(doubleEquals(actual.getMean(), expected.getMean(), 1e-12));
+                assert(doubleEquals(actual.getVariance(), expected.getVariance(), 1e-12));
+            }
+        }
+    }
+    // the wiener process has variance t
+    for (int it = 1; it < numTimes; ++it) {
+        const RunningStatistics & w = fromBlock.getStatistics(it, W);
+        double t = timeVector->getTimeAtIndex(it);
+        assert(std::abs(w.getMean()) < 4 * w.getStandardError());
+        assert(std::abs(w.getVariance() - t) < .15 * t);
+    }
+
+    bool isThrown = false;
+    try {
+        fromBlock.merge(PathStatistics(timeVector, 1));
+    } catch (std::invalid_argument &) {
+        isThrown = true;
+    }
+    assert(isThrown);
+}
+
+
+void testGenerateUntilConverged() {
+    info("testGenerateUntilConverged");
+    using namespace irm;
+    const int numTimes = 11;
+    const std::uint64_t seed = 5;
+    auto process = std::make_shared<WienerProcess>(ITimeVector::createUniform(0, .1, numTimes), 0);
+    StateVariable W(0);
+    std::vector<int> observationIndices{5, numTimes - 1};
+    // W(.5) has variance .5, W(1)^2 has variance 2
+    MonteCarloEngine::ConvergenceTarget halfway{
+            [=](const PathBlock & paths, int path) { return paths.getValue(path, 0, W); }, .02 };
+    MonteCarloEngine::ConvergenceTarget squared{
+            [=](const PathBlock & paths, int path) { double w = paths.getValue(path, 1, W); return w * w; }, .03 };
+
+    auto singleThreaded = MonteCarloEngine(process, 100000, seed, 1).generateUntilConverged({halfway, squared}, observationIndices, 250);
+    auto multiThreaded = MonteCarloEngine(process, 100000, seed, 4).generateUntilConverged({halfway, squared}, observationIndices, 250);
+    assert(singleThreaded.isConverged && multiThreaded.isConverged);
+    // the harder target decides, about 2 / .03^2 paths
+    assert(singleThreaded.numPaths % 250 == 0 && singleThreaded.numPaths > 1500 && singleThreaded.numPaths < 3000);
+    assert(multiThreaded.numPaths == singleThreaded.numPaths);
+    for (int iq = 0; iq < 2; ++iq) {
+        assert(multiThreaded.statistics[iq].getMean() == singleThreaded.statistics[iq].getMean());
+        assert(multiThreaded.statistics[iq].getVariance() == singleThreaded.statistics[iq].getVariance());
+    }
+    assert(singleThreaded.statistics[0].getStandardError() < .02);
+    assert(std::abs(singleThreaded.statistics[1].getMean() - 1) < 4 * .03);
+
+    // the first target only reuses the first paths of the same sequence
+    auto easy = MonteCarloEngine(process, 100000, seed, 2).generateUntilConverged({halfway}, observationIndices, 250);
+    assert(easy.numPaths < singleThreaded.numPaths);
+    auto block = MonteCarloEngine(process, easy.numPaths, seed, 3).generatePaths(observationIndices);
+    RunningStatistics expected;
+    for (int ip = 0; ip < easy.numPaths; ++ip)
+        expected.add(block->getValue(ip, 0, W));
+    assert(easy.statistics[0].getMean() == expected.getMean());
+    // quantities may take single paths out of the batch
+    MonteCarloEngine::ConvergenceTarget fromPath{
+            [=](const PathBlock & paths, int path) { return paths.getPath(path)->getStateAtIndex(0).getValue(W); }, .02 };
+    auto viaPaths = MonteCarloEngine(process, 100000, seed, 2).generateUntilConverged({fromPath}, observationIndices, 250);
+    assert(viaPaths.numPaths == easy.numPaths && viaPaths.statistics[0].getMean() == expected.getMean());
+
+    // quantities are evaluated on the calling thread, once per path
+    auto callingThread = std::this_thread::get_id();
+    int numEvaluations = 0;
+    MonteCarloEngine::ConvergenceTarget counted{
+            [&](const PathBlock &, int) { assert(std::this_thread::get_id() == callingThread); return ++numEvaluations % 2; }, .05 };
+    auto countedResult = MonteCarloEngine(process, 100000, seed, 4).generateUntilConverged({counted}, observationIndices, 100);
+    assert(countedResult.isConverged && numEvaluations == countedResult.numPaths);
+
+    // the path budget stops a target that cannot be reached
+    auto budgeted = MonteCarloEngine(process, 1100, seed, 2).generateUntilConverged({squared}, observationIndices, 500);
+    assert(!budgeted.isConverged && budgeted.numPaths == 1100);
+}
+
+
+void testPathStore() {
+    info("testPathStore");
+    using namespace irm;
+    const int numTimes = 7;
+    const int numPaths = 40;
+    const std::uint64_t seed = 77;
+    auto timeVector = ITimeVector::createFromVector({0, .1, .25, .5, 1, 2, 5});
+    auto process = std::make_shared<WienerProcess>(timeVector, 0);
+    StateVariable X = process->getNextStateVariable();
+    process->addItoIntegralProcess(expr::Constant(.02), .1 * expr::X(X), 1);
+    auto block = MonteCarloEngine(process, numPaths, seed, 2).generatePaths();
+    std::string fileName = (std::filesystem::temp_directory_path() / "test_probability_paths.bin").string();
+
+    {
+        PathStoreWriter writer(fileName, timeVector, {"W", "X"}, seed);
+        // a block, then single paths
+        writer.writePaths(*block);
+        for (int ip = 0; ip < 3; ++ip)
+            writer.writePath(*block->getPath(ip));
+        assert(writer.getNumPaths() == numPaths + 3);
+    }
+
+    IPathCPtr lastPath;
+    {
+        PathStoreCPtr store = PathStore::open(fileName);
+        assert(store->getNumPaths() == numPaths + 3);
+        assert(store->getNumTimes() == numTimes && store->getStateSize() == 2);
+        assert(store->getSeed() == seed);
+        assert(store->getVariableNames() == std::vector<std::string>({"W", "X"}));
+        assert(store->getStateVariable("X").index == X.index);
+        for (int it = 0; it < numTimes; ++it)
+            assert(store->getTimeVector()->getTimeAtIndex(it) == timeVector->getTimeAtIndex(it));
+        for (int ip = 0; ip < numPaths + 3; ++ip) {
+            auto path = store->getPath(ip);
+            for (int it = 0; it < numTimes; ++it) {
+                for (int iv = 0; iv < 2; ++iv) {
+                    double expected = block->getValue(ip % numPaths, it, StateVariable(iv));
+                    assert(path->getStateAtIndex(it).getValue(StateVariable(iv)) == expected);
+                    assert(store->getValues(ip)[it * 2 + iv] == expected);
+                }
+            }
+        }
+        lastPath = store->getPath(numPaths + 2);
+        bool isThrown = false;
+        try {
+            store->getStateVariable("Y");
+        } catch (std::invalid_argument &) {
+            isThrown = true;
+        }
+        assert(isThrown);
+    }
+    // the path keeps the mapping alive
+    assert(lastPath->getStateAtIndex(numTimes - 1).getValue(X) == block->getValue(2, numTimes - 1, X));
+    // the mapping is read-only, and so are its paths
+    bool isModified = true;
+    try {
+        const_cast<IPath &>(*lastPath).getStateAtIndex(0);
+    } catch (std::logic_error &) {
+        isModified = false;
+    }
+    assert(!isModified);
+
+    // a header whose sizes overflow is rejected rather than trusted
+    const std::uint64_t corruptions[][2] = {
+            {32, std::uint64_t(1) << 62}, // numPaths
+            {40, std::numeric_limits<std::uint64_t>::max() - 7}}; // valuesOffset
+    for (const auto & corruption : corruptions) {
+        {
+            PathStoreWriter writer(fileName, timeVector, {"W", "X"}, seed);
+            writer.writePaths(*block);
+        }
+        {
+            std::fstream file(fileName, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(corruption[0]);
+            file.write(reinterpret_cast<const char *>(&corruption[1]), sizeof(std::uint64_t));
+        }
+        bool isRejected = false;
+        try {
+            PathStore::open(fileName);
+        } catch (std::runtime_error &) {
+            isRejected = true;
+        }
+        assert(isRejected);
+    }
+
+    // a file that is not a store is rejected
+    {
+        std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+        file << "not a path store, but long enough to hold a header";
+    }
+    bool isThrown = false;
+    try {
+        PathStore::open(fileName);
+    } catch (std::runtime_error &) {
+        isThrown = true;
+    }
+    assert(isThrown);
+    std::filesystem::remove(fileName);
+}
+
+
+void testPathExporter() {
+    info("testPathExporter");
+    using namespace irm;
+    const int numTimes = 9;
+    const int numPaths = 50;
+    auto timeVector = ITimeVector::createUniform(0, .25, numTimes);
+    auto process = std::make_shared<WienerProcess>(timeVector, 0);
+    StateVariable W(0);
+    StateVariable X = process->getNextStateVariable();
+    process->addItoIntegralProcess(-expr::X(X), expr::Constant(.3), 1);
+    auto block = MonteCarloEngine(process, numPaths, 8, 2).generatePaths();
+    std::vector<int> timeIndices{0, 4, 8};
+    auto exportAll = [&](const std::string & fileName, PathExporter::Format format) {
+        // small buffers, so that the writer thread gets many of them
+        PathExporter exporter(fileName, format, timeVector, timeIndices, {X, W}, {"X", "W"}, 7);
+        assert(exporter.getNumColumns() == 6);
+        exporter.exportPaths(*block);
+        for (int ip = 0; ip < 10; ++ip)
+            exporter.exportPath(*block->getPath(ip));
+        assert(exporter.getNumPaths() == numPaths + 10);
+        exporter.close();
+    };
+    // column ic of path ip
+    auto expected = [&](int ip, int ic) {
+        return block->getValue(ip % numPaths, timeIndices[ic % 3], ic < 3 ? X : W);
+    };
+    auto directory = std::filesystem::temp_directory_path();
+
+    std::string csvName = (directory / "test_probability_paths.csv").string();
+    exportAll(csvName, PathExporter::Format::Csv);
+    {
+        std::ifstream csv(csvName);
+        std::string line;
+        std::getline(csv, line);
+        assert(line == "path,X@0,X@1,X@2,W@0,W@1,W@2");
+        int ip = 0;
+        for (; std::getline(csv, line); ++ip) {
+            std::istringstream row(line);
+            std::string cell;
+            std::getline(row, cell, ',');
+            assert(std::stoi(cell) == ip);
+            for (int ic = 0; ic < 6; ++ic) {
+                std::getline(row, cell, ',');
+                // the shortest representation round trips
+                assert(std::stod(cell) == expected(ip, ic));
+            }
+        }
+        assert(ip == numPaths + 10);
+    }
+    std::filesystem::remove(csvName);
+
+    std::string binaryName = (directory / "test_probability_paths.cols").string();
+    exportAll(binaryName, PathExporter::Format::BinaryColumns);
+    {
+        std::ifstream binary(binaryName, std::ios::binary);
+        auto read = [&](auto & value) { binary.read(reinterpret_cast<char *>(&value), sizeof(value)); };
+        char magic[8];
+        binary.read(magic, 8);
+        assert(std::string(magic, 8) == "IRMCOLS1");
+        std::uint32_t numColumns, reserved;
+        read(numColumns);
+        read(reserved);
+        assert(numColumns == 6);
+        for (std::uint32_t ic = 0; ic < numColumns; ++ic) {
+            double t;
+            std::uint32_t index, length;
+            read(t);
+            read(index);
+            read(length);
+            std::string name(length, ' ');
+            binary.read(name.data(), length);
+            assert(t == timeVector->getTimeAtIndex(timeIndices[ic % 3]));
+            assert(static_cast<int>(index) == (ic < 3 ? X : W).index);
+            assert(name[0] == (ic < 3 ? 'X' : 'W'));
+        }
+        int firstPath = 0;
+        std::uint64_t numRows;
+        for (read(numRows); binary; read(numRows)) {
+            assert(numRows > 0 && numRows <= 7);
+            for (std::uint32_t ic = 0; ic < numColumns; ++ic) {
+                for (std::uint64_t ir = 0; ir < numRows; ++ir) {
+                    double value;
+                    read(value);
+                    assert(value == expected(firstPath + ir, ic));
+                }
+            }
+            firstPath += numRows;
+        }
+        assert(firstPath == numPaths + 10);
+    }
+    std::filesystem::remove(binaryName);
+
+    // once the writer fails, every export and the close report it instead of overrunning the buffers
+    if (std::filesystem::exists("/dev/full")) {
+        PathExporter exporter("/dev/full", PathExporter::Format::BinaryColumns, timeVector, timeIndices, {X, W}, {"X", "W"}, 7);
+        int numFailures = 0;
+        for (int ip = 0; ip < numPaths; ++ip) {
+            try {
+                exporter.exportPath(*block->getPath(ip));
+            } catch (std::runtime_error &) {
+                ++numFailures;
+            }
+        }
+        // the first buffer fails to write, which the second hand over reports
+        assert(numFailures == numPaths - 2 * 7 + 1);
+        bool isThrown = false;
+        try {
+            exporter.exportPaths(*block);
+        } catch (std::runtime_error &) {
+            isThrown = true;
+        }
+        assert(isThrown);
+        isThrown = false;
+        try {
+            exporter.close();
+        } catch (std::runtime_error &) {
+            isThrown = true;
+        }
+        assert(isThrown);
+    }
+}
+
+
+void testScenarioCache() {
+    info("testScenarioCache");
+    using namespace irm;
+    const int numTimes = 5;
+    const int numPaths = 20;
+    auto timeVector = ITimeVector::createUniform(0, .5, numTimes);
+    auto process = std::make_shared<WienerProcess>(timeVector, 0);
+    int numGenerations = 0;
+    auto generate = [&](std::uint64_t seed) {
+        return [&, seed]() {
+            ++numGenerations;
+            return MonteCarloEngine(process, numPaths, seed, 2).generatePaths();
+        };
+    };
+    auto directory = std::filesystem::temp_directory_path() / "test_probability_scenarios";
+    std::filesystem::remove_all(directory);
+    // room in memory for one store
+    const size_t storeBytes = numPaths * numTimes * sizeof(double);
+    ScenarioCache cache(directory.string(), storeBytes);
+
+    ScenarioCache::Key key{"wiener", timeVector, "Philox4x32-10", 1, 0, numPaths};
+    ScenarioCache::Key otherSeed = key;
+    otherSeed.seed = 2;
+    ScenarioCache::Key otherTimes = key;
+    otherTimes.timeVector = ITimeVector::createUniform(0, .25, numTimes);
+    assert(ScenarioCache::hash(key) == ScenarioCache::hash(ScenarioCache::Key(key)));
+    assert(ScenarioCache::hash(key) != ScenarioCache::hash(otherSeed));
+    assert(ScenarioCache::hash(key) != ScenarioCache::hash(otherTimes));
+    assert(!cache.find(key));
+
+    auto generated = cache.getOrGenerate(key, {"W"}, generate(1));
+    auto fromMemory = cache.getOrGenerate(key, {"W"}, generate(1));
+    assert(numGenerations == 1 && fromMemory == generated);
+    assert(cache.getNumMisses() == 1 && cache.getNumMemoryHits() == 1);
+    assert(cache.getMemoryBytes() == storeBytes);
+
+    // a second store evicts the first from memory, which is then served from disk
+    cache.getOrGenerate(otherSeed, {"W"}, generate(2));
+    assert(cache.getMemoryBytes() == storeBytes);
+    auto fromDisk = cache.find(key);
+    assert(numGenerations == 2 && cache.getNumDiskHits() == 1);
+    assert(fromDisk != generated);
+    auto expected = MonteCarloEngine(process, numPaths, 1, 1).generatePaths();
+    for (int ip = 0; ip < numPaths; ++ip)
+        for (int it = 0; it < numTimes; ++it)
+            assert(fromDisk->getPath(ip)->getStateAtIndex(it).getValue(StateVariable(0)) == expected->getValue(ip, it, StateVariable(0)));
+
+    // a new cache on the same directory starts from the disk
+    ScenarioCache restarted(directory.string(), 0);
+    assert(restarted.getOrGenerate(otherSeed, {"W"}, generate(2))->getSeed() == 2);
+    assert(numGenerations == 2 && restarted.getNumDiskHits() == 1 && restarted.getMemoryBytes() == 0);
+
+    // the cache is not locked while generating, and threads asking for the same key share one generation
+    ScenarioCache::Key otherPaths = key;
+    otherPaths.pathBegin = numPaths;
+    std::atomic<int> numConcurrentGenerations(0);
+    auto generateConcurrently = [&]() {
+        ++numConcurrentGenerations;
+        assert(restarted.find(key) && restarted.getNumMisses() == 1);
+        return MonteCarloEngine(process, numPaths, 3, 1).generatePaths();
+    };
+    std::vector<std::thread> threads;
+    std::vector<PathStoreCPtr> stores(4);
+    for (int i = 0; i < 4; ++i)
+        threads.emplace_back([&, i]() { stores[i] = restarted.getOrGenerate(otherPaths, {"W"}, generateConcurrently); });
+    for (std::thread & thread : threads)
+        thread.join();
+    assert(numConcurrentGenerations == 1 && restarted.getNumMisses() == 1);
+    for (const PathStoreCPtr & store : stores)
+        assert(store && store->getNumPaths() == numPaths);
+    for (const auto & file : std::filesystem::directory_iterator(directory))
+        assert(file.path().extension() == ".paths");
+    std::filesystem::remove_all(directory);
+}